@@ -0,0 +1,367 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ * decode-bench: measures the throughput of the decoder (header parsing,
+ * record scanning and click decoding) on synthetic data files of the given
+ * sizes, and on any data files given on the command line. The results are
+ * written as JSON, so that they can be compared between releases. See
+ * `decode-bench --help`, and the Makefile for how to build it.
+ *
+*/
+
+#define FPOD_MAPPED_FILE_IMPLEMENTATION
+#include <fpod.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* usage =
+"Usage: decode-bench [options] [FILE...]\n"
+"\n"
+"Measures decoder throughput on synthetic data files, and on the given data\n"
+"files, and writes the results as JSON.\n"
+"\n"
+"Options:\n"
+"  -s, --sizes LIST      comma separated sizes of the synthetic files, in MB\n"
+"                        (default: 1,10,100; 0 for none)\n"
+"  -t, --types LIST      comma separated types of the synthetic files\n"
+"                        (default: FP1,FP3,CP1,CP3)\n"
+"      --click-rate N    clicks per minute in the synthetic files (default: 2000)\n"
+"  -d, --dir DIR         directory for the synthetic files, which are reused\n"
+"                        if they exist (default: fpod-bench in the temp dir)\n"
+"  -r, --reps N          repetitions of each benchmark (default: 5)\n"
+"  -o, --output PATH     JSON output file (default: - for standard output)\n"
+"  -h, --help            show this message\n"
+"\n"
+"Stages: header (fpod::parseHeader), scan (fpod::decodeRecords, without\n"
+"decoding the clicks) and decode (fpod::decodeRecords and fpod::decodeClick\n"
+"for every click), each with the file mapped into (warm) memory, and read\n"
+"(reading the whole file with std::ifstream).\n";
+
+struct Options {
+    std::vector<std::string> files;
+    std::vector<double> sizes{1, 10, 100};
+    std::vector<std::string> types{"FP1", "FP3", "CP1", "CP3"};
+    double click_rate{2000};
+    std::string dir{(fs::temp_directory_path() / "fpod-bench").string()};
+    int reps{5};
+    std::string output{"-"};
+};
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::string toUpper(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    return text;
+}
+
+int parseOptions(int argc, char** argv, Options& options) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= args.size()) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return args[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            std::cout << usage;
+            return 1;
+        } else if (arg == "-s" || arg == "--sizes") {
+            options.sizes.clear();
+            for (const std::string& size : splitList(value())) {
+                if (std::atof(size.c_str()) > 0) {
+                    options.sizes.push_back(std::atof(size.c_str()));
+                }
+            }
+        } else if (arg == "-t" || arg == "--types") {
+            options.types.clear();
+            for (const std::string& type : splitList(value())) {
+                fpod::Format format = fpod::getFormat(toUpper(type));
+                if (!format.is_fpod() && !format.is_cpod()) {
+                    throw std::runtime_error("unknown file type " + type);
+                }
+                options.types.push_back(format.ext);
+            }
+        } else if (arg == "--click-rate") {
+            options.click_rate = std::atof(value().c_str());
+        } else if (arg == "-d" || arg == "--dir") {
+            options.dir = value();
+        } else if (arg == "-r" || arg == "--reps") {
+            options.reps = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = value();
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("unknown option " + arg);
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return 0;
+}
+
+// syntheticFile: returns the path of a synthetic file of (about) the given
+// size, writing it first if needed
+fs::path syntheticFile(const Options& options, const std::string& type, double size_mb) {
+    fpod::Format format = fpod::getFormat(type);
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "synthetic_%gMB_%g.%s", size_mb,
+                  options.click_rate, type.c_str());
+    fs::path path = fs::path(options.dir) / name;
+    if (fs::exists(path)) {
+        return path;
+    }
+    fs::create_directories(options.dir);
+
+    // the expected number of records per minute, from the generator's
+    // default train and wav densities
+    fpod::SyntheticOptions synthetic;
+    double per_click = 1;
+    if (format.ext == "FP3") {
+        per_click += synthetic.train_density;
+    }
+    if (format.is_fpod()) {
+        per_click += synthetic.wav_density * 2;
+    }
+    double minute_bytes = format.record_size * (1 + options.click_rate * per_click);
+    synthetic.minutes = std::max<int64_t>(1, static_cast<int64_t>(size_mb * 1e6 / minute_bytes));
+    synthetic.click_rate = options.click_rate;
+
+    fpod::Header header;
+    header.pod_id = "1";
+    header.first_logged_min = 65217600; // 2024-01-01
+    header.last_logged_min = header.first_logged_min + static_cast<int32_t>(synthetic.minutes);
+    header.pic_ver = 30;
+    header.fpga_ver = 900;
+
+    std::cerr << "decode-bench: writing " << path.string() << "\n";
+    if (fpod::writeSynthetic(path.string(), format, header, synthetic) < 0) {
+        throw std::runtime_error("unable to write " + path.string());
+    }
+    return path;
+}
+
+// CountingHandler: counts the records, without decoding the clicks
+struct CountingHandler {
+    uint64_t n_clicks{0};
+    uint64_t n_wav{0};
+    uint64_t n_minutes{0};
+
+    void click(const fpod::ClickRef&) { n_clicks++; }
+    void wav(const fpod::WavRecord&) { n_wav++; }
+    void minute(const fpod::EnvRecord&) { n_minutes++; }
+};
+
+// DecodingHandler: decodes every click, and sums up the fields so that the
+// compiler can't skip the decoding
+struct DecodingHandler {
+    fpod::Format format;
+    uint64_t clicks{0};
+    uint64_t checksum{0};
+
+    void click(const fpod::ClickRef& ref) {
+        fpod::ClickRecord click;
+        fpod::decodeClick(ref.data, format, click);
+        checksum += static_cast<uint64_t>(click.microsec) + click.ncyc + click.amp_at_max +
+            static_cast<uint64_t>(ref.minute) + (ref.train ? ref.train->species : 0);
+        clicks++;
+    }
+    void wav(const fpod::WavRecord& record) { checksum += record.spl[0]; }
+    void minute(const fpod::EnvRecord& env) { checksum += static_cast<uint64_t>(env.temp_deg_c); }
+};
+
+struct Result {
+    std::string file;
+    std::string type;
+    std::string stage;
+    uint64_t bytes;
+    uint64_t records;
+    uint64_t clicks;
+    std::vector<double> seconds;
+};
+
+// timeIt: runs f once to warm up, and then reps times
+template<class F>
+std::vector<double> timeIt(int reps, F f) {
+    f();
+    std::vector<double> seconds;
+    for (int i = 0; i < reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        seconds.push_back(std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return seconds;
+}
+
+std::vector<Result> benchmarkFile(const fs::path& path, int reps) {
+    std::string type = toUpper(path.extension().string().substr(1));
+    fpod::Format format = fpod::getFormat(type);
+    fpod::MappedFile file(path.string());
+    if (!file.is_open() || file.size() < format.header_size) {
+        throw std::runtime_error("unable to read " + path.string());
+    }
+    uint64_t bytes = file.size();
+    uint64_t records = (bytes - format.header_size) / format.record_size;
+    fpod::Header header = fpod::parseHeader(file.data(), format);
+
+    CountingHandler counts;
+    fpod::decodeRecords(file.data(), file.size(), format, header, counts);
+
+    std::vector<Result> results;
+    auto add = [&](const std::string& stage, uint64_t stage_bytes, uint64_t stage_records,
+                   std::vector<double> seconds) {
+        results.push_back({path.string(), type, stage, stage_bytes, stage_records,
+                           counts.n_clicks, std::move(seconds)});
+    };
+
+    // headers are small, so they are parsed many times per repetition
+    const int n_headers = 10000;
+    volatile int32_t sink = 0;
+    add("header", format.header_size * n_headers, n_headers, timeIt(reps, [&]() {
+        for (int i = 0; i < n_headers; i++) {
+            sink = fpod::parseHeader(file.data(), format).first_logged_min;
+        }
+    }));
+
+    add("scan", bytes, records, timeIt(reps, [&]() {
+        CountingHandler handler;
+        fpod::decodeRecords(file.data(), file.size(), format, header, handler);
+        sink = static_cast<int32_t>(handler.n_clicks);
+    }));
+
+    add("decode", bytes, records, timeIt(reps, [&]() {
+        DecodingHandler handler{format};
+        fpod::decodeRecords(file.data(), file.size(), format, header, handler);
+        sink = static_cast<int32_t>(handler.checksum);
+    }));
+
+    add("read", bytes, records, timeIt(reps, [&]() {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> buffer(1 << 20);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+            sink = buffer[0];
+        }
+    }));
+
+    return results;
+}
+
+double median(std::vector<double> x) {
+    std::sort(x.begin(), x.end());
+    size_t n = x.size();
+    return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string ret = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+        }
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n";
+    out << "  \"benchmark\": \"decode-bench\",\n";
+    out << "  \"timestamp\": \"" << timestamp << "\",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": " << jsonString(__VERSION__) << ",\n";
+#endif
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double med = median(r.seconds);
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "\"stage\": \"%s\", \"type\": \"%s\", \"bytes\": %" PRIu64
+                      ", \"records\": %" PRIu64 ", \"clicks\": %" PRIu64
+                      ", \"reps\": %zu, \"seconds_min\": %.6g, \"seconds_median\": %.6g"
+                      ", \"records_per_sec\": %.6g, \"mb_per_sec\": %.6g",
+                      r.stage.c_str(), r.type.c_str(), r.bytes, r.records, r.clicks,
+                      r.seconds.size(), *std::min_element(r.seconds.begin(), r.seconds.end()),
+                      med, r.records / med, r.bytes / med / 1e6);
+        out << (i ? "," : "") << "\n    {\"file\": " << jsonString(r.file) << ", " << line << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+    Options options;
+    std::vector<Result> results;
+    try {
+        if (int status = parseOptions(argc, argv, options)) {
+            return status == 1 ? 0 : status;
+        }
+
+        std::vector<fs::path> files;
+        for (double size : options.sizes) {
+            for (const std::string& type : options.types) {
+                files.push_back(syntheticFile(options, type, size));
+            }
+        }
+        files.insert(files.end(), options.files.begin(), options.files.end());
+
+        for (const fs::path& file : files) {
+            std::cerr << "decode-bench: " << file.string() << "\n";
+            std::vector<Result> file_results = benchmarkFile(file, options.reps);
+            results.insert(results.end(), file_results.begin(), file_results.end());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "decode-bench: " << e.what() << "\n";
+        return 2;
+    }
+
+    if (options.output == "-") {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream out(options.output);
+        writeJson(out, results);
+        if (!out) {
+            std::cerr << "decode-bench: unable to write " << options.output << "\n";
+            return 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,641 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ * fpod-convert: converts FPOD and CPOD data files (FP1, FP3, CP1, CP3) to CSV
+ * or to a compact binary columnar format, using the same decoder as the R
+ * package. See `fpod-convert --help`, and the Makefile for how to build it.
+ *
+*/
+
+#define FPOD_MAPPED_FILE_IMPLEMENTATION
+#include <fpod.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* usage =
+"Usage: fpod-convert [options] FILE|DIR...\n"
+"\n"
+"Converts the clicks in FPOD/CPOD data files to CSV or to a binary columnar\n"
+"format. Directories are searched (recursively) for data files.\n"
+"\n"
+"Options:\n"
+"  -o, --output PATH     output file, or directory with one output file per\n"
+"                        input file (default: - for standard output, CSV only)\n"
+"  -f, --format FORMAT   csv (default) or col (binary columnar)\n"
+"  -c, --columns LIST    comma separated columns to write (default: all)\n"
+"  -s, --species LIST    comma separated species to keep, e.g. NBHF,Sonar\n"
+"  -q, --quality N       keep clicks with quality_level >= N\n"
+"      --from TIME       keep clicks at or after TIME (YYYY-MM-DD[ HH:MM[:SS]])\n"
+"      --to TIME         keep clicks before TIME\n"
+"  -j, --threads N       number of files to decode in parallel\n"
+"                        (default: number of cores)\n"
+"  -h, --help            show this message\n"
+"\n"
+"Times are the pod's clock, written as UTC. The values are those stored in\n"
+"the file, i.e. without the kHz and extended amplitude conversions done by\n"
+"fp_read() in R.\n";
+
+// Row: one decoded click, with the same columns as fp_read() in R
+struct Row {
+    std::string_view pod;
+    int64_t time_ns; // nanoseconds since 1970-01-01
+    int minute;
+    fpod::ClickRecord click;
+    uint64_t click_no;
+    fpod::TrainRecord train;
+    bool has_wav;
+};
+
+enum ColumnType { COL_INT32, COL_INT64, COL_FLOAT64, COL_STRING };
+
+struct Column {
+    const char* name;
+    ColumnType type;
+};
+
+// the available columns, in the order of fp_read()
+const Column columns[] = {
+    {"pod", COL_STRING}, {"time", COL_INT64}, {"minute", COL_INT32},
+    {"microsec", COL_INT32}, {"click_no", COL_INT64}, {"train_id", COL_INT32},
+    {"species", COL_STRING}, {"quality_level", COL_INT32}, {"echo", COL_INT32},
+    {"ncyc", COL_INT32}, {"pkat", COL_INT32}, {"clk_ipi_range", COL_INT32},
+    {"ipi_pre_max", COL_INT32}, {"ipi_at_max", COL_INT32}, {"khz", COL_INT32},
+    {"amp_at_max", COL_INT32}, {"amp_reversals", COL_INT32},
+    {"duration", COL_FLOAT64}, {"has_wav", COL_INT32}
+};
+const int n_columns = sizeof(columns) / sizeof(columns[0]);
+
+int64_t intValue(const Row& row, int col) {
+    const fpod::ClickRecord& c = row.click;
+    switch (col) {
+    case 1: return row.time_ns;
+    case 2: return row.minute;
+    case 3: return c.microsec;
+    case 4: return static_cast<int64_t>(row.click_no);
+    case 5: return row.train.train_id;
+    case 7: return row.train.quality_level;
+    case 8: return row.train.echo;
+    case 9: return c.ncyc;
+    case 10: return c.pkat;
+    case 11: return c.clk_ipi_range;
+    case 12: return c.ipi_pre_max;
+    case 13: return c.ipi_at_max;
+    case 14: return c.khz;
+    case 15: return c.amp_at_max;
+    case 16: return c.amp_reversals;
+    case 18: return row.has_wav;
+    default: return 0;
+    }
+}
+
+std::string_view stringValue(const Row& row, int col) {
+    if (col == 0) {
+        return row.pod;
+    }
+    return fpod::species_names[row.train.species];
+}
+
+// daysFromCivil: days since 1970-01-01 of a (proleptic Gregorian) date
+int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// formatTime: formats nanoseconds since 1970 as YYYY-MM-DD HH:MM:SS.ffffff
+std::string formatTime(int64_t ns) {
+    int64_t us = ns / 1000;
+    int64_t secs = us / 1000000;
+    int64_t frac = us % 1000000;
+    if (frac < 0) {
+        frac += 1000000;
+        secs--;
+    }
+    int64_t days = secs / 86400;
+    int64_t sod = secs % 86400;
+    if (sod < 0) {
+        sod += 86400;
+        days--;
+    }
+
+    // civilFromDays (the inverse of daysFromCivil)
+    int64_t z = days + 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "%04" PRId64 "-%02u-%02u %02d:%02d:%02d.%06d",
+                  y, m, d, static_cast<int>(sod / 3600),
+                  static_cast<int>(sod / 60 % 60), static_cast<int>(sod % 60),
+                  static_cast<int>(frac));
+    return buf;
+}
+
+// parseTime: parses YYYY-MM-DD[ HH:MM[:SS]] into nanoseconds since 1970
+bool parseTime(const std::string& text, int64_t& ns) {
+    int y = 0, mo = 0, d = 0, h = 0, mi = 0, s = 0;
+    int n = std::sscanf(text.c_str(), "%d-%d-%d%*[ T]%d:%d:%d", &y, &mo, &d, &h, &mi, &s);
+    if (n != 3 && n != 5 && n != 6) {
+        return false;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || s > 59) {
+        return false;
+    }
+    int64_t secs = daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+    ns = secs * 1000000000;
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::string toUpper(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    return text;
+}
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::string output{"-"};
+    std::string format{"csv"};
+    std::vector<int> columns; // indices into columns[]
+    std::vector<bool> species; // by index into species_names; empty for all
+    int min_quality{0};
+    int64_t from_ns{std::numeric_limits<int64_t>::min()};
+    int64_t to_ns{std::numeric_limits<int64_t>::max()};
+    unsigned threads{0};
+};
+
+// Sink: receives the rows of one file that pass the filters
+class Sink {
+public:
+    virtual ~Sink() = default;
+    virtual void add(const Row& row) = 0;
+    virtual bool finish() = 0;
+};
+
+class CsvSink : public Sink {
+public:
+    CsvSink(std::ostream& m_out, const std::vector<int>& m_columns, bool header) :
+        out(m_out), cols(m_columns) {
+        if (header) {
+            for (size_t k = 0; k < cols.size(); k++) {
+                out << (k ? "," : "") << columns[cols[k]].name;
+            }
+            out << '\n';
+        }
+    }
+
+    void add(const Row& row) override {
+        for (size_t k = 0; k < cols.size(); k++) {
+            int col = cols[k];
+            if (k) {
+                out << ',';
+            }
+            switch (columns[col].type) {
+            case COL_STRING: out << stringValue(row, col); break;
+            case COL_FLOAT64: out << row.click.duration; break;
+            case COL_INT64:
+                if (col == 1) {
+                    out << formatTime(row.time_ns);
+                } else {
+                    out << intValue(row, col);
+                }
+                break;
+            default: out << intValue(row, col);
+            }
+        }
+        out << '\n';
+    }
+
+    bool finish() override {
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+private:
+    std::ostream& out;
+    std::vector<int> cols;
+};
+
+// ColumnarSink: the binary columnar format is little-endian, and starts with
+// the magic bytes "FPODCOL1", followed by the number of rows (uint64) and the
+// number of columns (uint32). Then, for each column: the length of its name
+// (uint32), the name, the type (uint8: 0 int32, 1 int64, 2 float64, 3 string),
+// and the values. Strings are stored as a dictionary: the number of levels
+// (uint32), each level (uint32 length + bytes), and then a uint8 code for
+// each row. Times are int64 nanoseconds since 1970-01-01.
+class ColumnarSink : public Sink {
+public:
+    ColumnarSink(const std::string& m_path, const std::vector<int>& m_columns) :
+        path(m_path), cols(m_columns), data(m_columns.size()) {}
+
+    void add(const Row& row) override {
+        for (size_t k = 0; k < cols.size(); k++) {
+            int col = cols[k];
+            switch (columns[col].type) {
+            case COL_STRING: {
+                std::string_view value = stringValue(row, col);
+                auto& levels = dictionaries[col];
+                auto it = std::find(levels.begin(), levels.end(), value);
+                if (it == levels.end()) {
+                    levels.emplace_back(value);
+                    it = levels.end() - 1;
+                }
+                data[k].push_back(static_cast<uint8_t>(it - levels.begin()));
+                break;
+            }
+            case COL_FLOAT64: append(data[k], row.click.duration); break;
+            case COL_INT64: append(data[k], intValue(row, col)); break;
+            default: append(data[k], static_cast<int32_t>(intValue(row, col)));
+            }
+        }
+        n_rows++;
+    }
+
+    bool finish() override {
+        std::ofstream out(path, std::ios::binary);
+        out.write("FPODCOL1", 8);
+        write(out, static_cast<uint64_t>(n_rows));
+        write(out, static_cast<uint32_t>(cols.size()));
+        for (size_t k = 0; k < cols.size(); k++) {
+            const Column& col = columns[cols[k]];
+            write(out, static_cast<uint32_t>(std::strlen(col.name)));
+            out.write(col.name, std::strlen(col.name));
+            write(out, static_cast<uint8_t>(col.type));
+            if (col.type == COL_STRING) {
+                const auto& levels = dictionaries[cols[k]];
+                write(out, static_cast<uint32_t>(levels.size()));
+                for (const auto& level : levels) {
+                    write(out, static_cast<uint32_t>(level.size()));
+                    out.write(level.data(), level.size());
+                }
+            }
+            out.write(reinterpret_cast<const char*>(data[k].data()), data[k].size());
+        }
+        return static_cast<bool>(out);
+    }
+
+private:
+    template<class T>
+    static void append(std::vector<uint8_t>& buf, T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        buf.insert(buf.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<class T>
+    static void write(std::ostream& out, T value) {
+        std::vector<uint8_t> buf;
+        append(buf, value);
+        out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    }
+
+    std::string path;
+    std::vector<int> cols;
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::string> dictionaries[n_columns];
+    uint64_t n_rows{0};
+};
+
+// Converter: the handler for fpod::decodeRecords(). Each click is held back
+// until the next click, since the pseudo-wav records that follow it set
+// has_wav.
+class Converter {
+public:
+    Converter(const Options& m_options, const fpod::Format& m_format,
+              const fpod::Header& header, Sink& m_sink) :
+        options(m_options), format(m_format), pod(header.pod_id), sink(m_sink) {
+        // minute 0 is the first logged minute, counted from 1900-01-01
+        origin_ns = (daysFromCivil(1900, 1, 1) * 1440 + header.first_logged_min) *
+            int64_t(60000000000);
+    }
+
+    void click(const fpod::ClickRef& ref) {
+        flush();
+        pending = true;
+        row.pod = pod;
+        row.minute = ref.minute;
+        row.click_no = ++n_clicks;
+        row.train = ref.train ? *ref.train : fpod::TrainRecord();
+        row.has_wav = false;
+        row.click = fpod::ClickRecord();
+        fpod::decodeClick(ref.data, format, row.click);
+        row.time_ns = origin_ns + row.minute * int64_t(60000000000) +
+            row.click.microsec * int64_t(1000);
+    }
+
+    void wav(const fpod::WavRecord&) {
+        row.has_wav = true;
+    }
+
+    void minute(const fpod::EnvRecord&) {}
+
+    // flush: passes the pending click on to the sink, if it passes the filters
+    void flush() {
+        if (!pending) {
+            return;
+        }
+        pending = false;
+        if (row.time_ns < options.from_ns || row.time_ns >= options.to_ns ||
+            row.train.quality_level < options.min_quality ||
+            (!options.species.empty() && !options.species[row.train.species])) {
+            return;
+        }
+        sink.add(row);
+    }
+
+private:
+    const Options& options;
+    const fpod::Format& format;
+    std::string pod;
+    Sink& sink;
+    int64_t origin_ns;
+    uint64_t n_clicks{0};
+    bool pending{false};
+    Row row;
+};
+
+bool isDataFile(const fs::path& path) {
+    std::string ext = toUpper(path.extension().string());
+    return ext == ".FP1" || ext == ".FP3" || ext == ".CP1" || ext == ".CP3";
+}
+
+// convertFile: converts one file, and returns an error message (or "")
+std::string convertFile(const fs::path& path, const Options& options,
+                        const fs::path& output, std::ostream* stream, bool header) {
+    if (!isDataFile(path)) {
+        return "unknown file type (must be FP1, FP3, CP1 or CP3)";
+    }
+    fpod::MappedFile file(path.string());
+    fpod::Format format = fpod::getFormat(toUpper(path.extension().string().substr(1)));
+    if (!file.is_open()) {
+        return "unable to open file";
+    }
+    if (file.size() < format.header_size) {
+        return "unable to read from file";
+    }
+
+    std::unique_ptr<Sink> sink;
+    std::ofstream out;
+    if (options.format == "col") {
+        sink = std::make_unique<ColumnarSink>(output.string(), options.columns);
+    } else {
+        if (!stream) {
+            out.open(output);
+            stream = &out;
+        }
+        sink = std::make_unique<CsvSink>(*stream, options.columns, header);
+    }
+
+    fpod::Header file_header = fpod::parseHeader(file.data(), format);
+    Converter converter(options, format, file_header, *sink);
+    fpod::decodeRecords(file.data(), file.size(), format, file_header, converter);
+    converter.flush();
+
+    return sink->finish() ? "" : "unable to write " + output.string();
+}
+
+int parseOptions(int argc, char** argv, Options& options) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::vector<std::string> column_names;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= args.size()) {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return args[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            std::cout << usage;
+            return 1;
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = value();
+        } else if (arg == "-f" || arg == "--format") {
+            options.format = value();
+            if (options.format != "csv" && options.format != "col") {
+                throw std::runtime_error("format must be csv or col");
+            }
+        } else if (arg == "-c" || arg == "--columns") {
+            column_names = splitList(value());
+        } else if (arg == "-s" || arg == "--species") {
+            options.species.assign(fpod::species_names.size(), false);
+            for (const std::string& name : splitList(value())) {
+                auto it = std::find_if(fpod::species_names.begin(), fpod::species_names.end(),
+                                       [&](const std::string& s) { return toUpper(s) == toUpper(name); });
+                if (it == fpod::species_names.end() || it->empty()) {
+                    throw std::runtime_error("unknown species " + name);
+                }
+                options.species[it - fpod::species_names.begin()] = true;
+            }
+        } else if (arg == "-q" || arg == "--quality") {
+            options.min_quality = std::atoi(value().c_str());
+        } else if (arg == "--from" || arg == "--to") {
+            std::string text = value();
+            int64_t& ns = arg == "--from" ? options.from_ns : options.to_ns;
+            if (!parseTime(text, ns)) {
+                throw std::runtime_error("invalid time " + text);
+            }
+        } else if (arg == "-j" || arg == "--threads") {
+            options.threads = static_cast<unsigned>(std::atoi(value().c_str()));
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("unknown option " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    for (const std::string& name : column_names) {
+        auto it = std::find_if(std::begin(columns), std::end(columns),
+                               [&](const Column& c) { return name == c.name; });
+        if (it == std::end(columns)) {
+            throw std::runtime_error("unknown column " + name);
+        }
+        options.columns.push_back(static_cast<int>(it - std::begin(columns)));
+    }
+    if (options.columns.empty()) {
+        for (int k = 0; k < n_columns; k++) {
+            options.columns.push_back(k);
+        }
+    }
+
+    if (options.inputs.empty()) {
+        std::cerr << usage;
+        return 2;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+    Options options;
+    try {
+        if (int status = parseOptions(argc, argv, options)) {
+            return status == 1 ? 0 : status;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "fpod-convert: " << e.what() << "\n";
+        return 2;
+    }
+
+    std::vector<fs::path> files;
+    for (const std::string& input : options.inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            for (const auto& entry : fs::recursive_directory_iterator(input, ec)) {
+                if (entry.is_regular_file() && isDataFile(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else {
+            files.push_back(input);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+
+    bool to_stdout = options.output == "-";
+    if (to_stdout && options.format != "csv") {
+        std::cerr << "fpod-convert: the col format needs an output file (-o)\n";
+        return 2;
+    }
+
+    // with several input files, the output is a directory with one file each
+    bool to_dir = !to_stdout && (files.size() > 1 || fs::is_directory(options.output));
+    if (to_dir) {
+        fs::create_directories(options.output);
+    }
+    auto outputPath = [&](const fs::path& file) {
+        if (!to_dir) {
+            return fs::path(options.output);
+        }
+        return fs::path(options.output) / (file.filename().string() + "." + options.format);
+    };
+
+    // files are decoded in parallel. For standard output (with more than one
+    // thread), each file is converted into a buffer, and the main thread
+    // writes the buffers in order, each as soon as it and the files before it
+    // are done. Workers don't start on a file more than max_pending files
+    // ahead of the last one written, which bounds the memory of the buffers.
+    unsigned n_threads = options.threads ? options.threads :
+        std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min<unsigned>(n_threads, std::max<size_t>(files.size(), 1));
+    bool buffered = to_stdout && n_threads > 1;
+    const size_t max_pending = 2 * static_cast<size_t>(n_threads);
+
+    std::ios::sync_with_stdio(false);
+    if (to_stdout) {
+        for (size_t k = 0; k < options.columns.size(); k++) {
+            std::cout << (k ? "," : "") << columns[options.columns[k]].name;
+        }
+        std::cout << '\n';
+    }
+
+    std::vector<std::string> errors(files.size());
+    std::vector<std::ostringstream> buffers(buffered ? files.size() : 0);
+    std::vector<char> done(files.size(), 0);
+    size_t written = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::atomic<size_t> next{0};
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            std::ostream* stream = nullptr;
+            if (buffered) {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return i < written + max_pending; });
+                stream = &buffers[i];
+            } else if (to_stdout) {
+                stream = &std::cout;
+            }
+            errors[i] = convertFile(files[i], options, outputPath(files[i]),
+                                    stream, !to_stdout);
+            if (buffered) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done[i] = 1;
+                changed.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = buffered ? 0 : 1; t < n_threads; t++) {
+        threads.emplace_back(worker);
+    }
+    if (buffered) {
+        for (size_t i = 0; i < files.size(); i++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return done[i] != 0; });
+            }
+            std::cout << buffers[i].str();
+            std::cout.flush();
+            std::ostringstream().swap(buffers[i]);
+            std::lock_guard<std::mutex> lock(mutex);
+            written = i + 1;
+            changed.notify_all();
+        }
+    } else {
+        worker();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!errors[i].empty()) {
+            std::cerr << "fpod-convert: " << files[i].string() << ": " << errors[i] << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}
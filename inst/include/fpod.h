@@ -0,0 +1,44 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+// The fpod decoding library: header parsing, record decoding and a streaming
+// decoder for FPOD and CPOD data files (FP1, FP3, CP1, CP3), and the matching
+// encoder, without any dependency on R. Packages can use it with `LinkingTo: fpod`.
+//
+//     fpod::MappedFile file(path);
+//     fpod::Format format = fpod::getFormat("FP3");
+//     fpod::Header header = fpod::parseHeader(file.data(), format);
+//     fpod::decodeRecords(file.data(), file.size(), format, header, handler);
+//
+// See fpod/decoder.h for the handler interface.
+//
+// Everything is header-only except fpod::MappedFile (and fpod::prefetchFile),
+// whose implementation is compiled only where FPOD_MAPPED_FILE_IMPLEMENTATION
+// is defined. Exactly one source file of a program or package that uses them
+// must define it before including this header (or fpod/mapped_file.h):
+//
+//     #define FPOD_MAPPED_FILE_IMPLEMENTATION
+//     #include <fpod.h>
+//
+// In an R package, that file must not include the R headers, since the
+// Windows implementation needs windows.h, which clashes with them; see
+// src/mapped_file.cpp in this package.
+
+#ifndef FPOD_INCLUDE_FPOD_H
+#define FPOD_INCLUDE_FPOD_H
+
+#include "fpod/records.h"
+#include "fpod/header.h"
+#include "fpod/validator.h"
+#include "fpod/decoder.h"
+#include "fpod/overview.h"
+#include "fpod/encoder.h"
+#include "fpod/synthetic.h"
+#include "fpod/mapped_file.h"
+
+#endif
@@ -0,0 +1,403 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_DECODER_H
+#define FPOD_INCLUDE_DECODER_H
+
+#include "records.h"
+#include "header.h"
+#include "validator.h"
+#include <cstddef>
+#include <memory> // for std::unique_ptr
+#include <cstdint>
+#include <type_traits> // for std::void_t
+#include <utility> // for std::declval
+#include <vector>
+
+namespace fpod {
+
+// ClickRef: a click record in the data, as passed to the handler. The record
+// itself is not decoded; use decodeClick(click.data, format, record) for that.
+struct ClickRef {
+    uint64_t record; // the (0-based) number of the record in the file
+    const uint8_t* data; // the record itself
+    int minute; // the number of minute records before the click, minus 1
+    const TrainRecord* train; // the classification of the click, or nullptr
+};
+
+namespace detail {
+
+// has_progress: whether a handler has a progress(uint64_t, uint64_t) method
+template<class Handler, class = void>
+struct has_progress : std::false_type {};
+
+template<class Handler>
+struct has_progress<Handler, std::void_t<decltype(
+    std::declval<Handler&>().progress(uint64_t(), uint64_t()))>> : std::true_type {};
+
+// about 1 MB of records between calls to handler.progress()
+inline uint64_t progressInterval(const Format& format) {
+    return (1 << 20) / format.record_size;
+}
+
+// reportProgress: counts down the records until the next call to
+// handler.progress(), if the handler has that method
+template<class Handler>
+inline void reportProgress(Handler& handler, uint64_t& countdown, uint64_t record,
+                           const Format& format, std::size_t size) {
+    if constexpr (has_progress<Handler>::value) {
+        if (--countdown == 0) {
+            countdown = progressInterval(format);
+            handler.progress(format.header_size + record * format.record_size, size);
+        }
+    }
+}
+
+template<class Handler>
+inline void reportDone(Handler& handler, std::size_t size) {
+    if constexpr (has_progress<Handler>::value) {
+        handler.progress(size, size);
+    }
+}
+
+} // namespace detail
+
+namespace detail {
+
+// decodeFPODRange/decodeCPODRange: decode records begin to end (exclusive),
+// where current_min is the minute of the clicks before the first minute
+// record. validator may be nullptr.
+template<class Handler>
+uint64_t decodeFPODRange(const uint8_t* data, std::size_t size,
+                         const Format& format, const Header& header, Handler& handler,
+                         uint64_t begin, uint64_t end, int current_min,
+                         RecordValidator* validator) {
+    uint64_t n_clicks = 0;
+
+    // click train data precedes the click it belongs to
+    TrainRecord train;
+    bool train_pending = false;
+    WavRecord wav;
+    EnvRecord env;
+    uint64_t countdown = progressInterval(format);
+
+    for (uint64_t record = begin; record < end; record++) {
+
+        reportProgress(handler, countdown, record, format, size);
+        const uint8_t* buf = data + format.header_size + record * format.record_size;
+
+        if (validator && !validator->check(record, buf)) {
+            // the train data belonged to a skipped click
+            train_pending = false;
+            continue;
+        }
+
+        if (isFPODClick(buf)) {
+            handler.click(ClickRef{record, buf, current_min,
+                                   train_pending ? &train : nullptr});
+            train_pending = false;
+            n_clicks++;
+        } else if (isFPODTrain(buf)) {
+            decodeFPODTrain(buf, format.ext, train);
+            train_pending = true;
+        } else if (isFPODWav(buf)) {
+            // wav data belongs to the click we just read
+            if (n_clicks > 0) {
+                decodeFPODWav(buf, wav);
+                handler.wav(wav);
+            }
+        } else if (isFPODMinute(buf)) {
+            current_min++;
+            decodeFPODMinute(buf, header.pic_ver, env);
+            handler.minute(env);
+        }
+    }
+    return n_clicks;
+}
+
+template<class Handler>
+uint64_t decodeCPODRange(const uint8_t* data, std::size_t size,
+                         const Format& format, const Header&, Handler& handler,
+                         uint64_t begin, uint64_t end, int current_min,
+                         RecordValidator* validator) {
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+    uint64_t n_clicks = 0;
+
+    int file_ends = 0;
+    bool has_trains = format.ext == "CP3";
+    TrainRecord train;
+    EnvRecord env;
+
+    // The end of data is indicated by two consecutive records where all
+    // values are 255, and the first of those looks like a click. So each
+    // click is only passed on once the next record shows that it wasn't the
+    // last one.
+    bool click_pending = false;
+    ClickRef pending{0, nullptr, -1, nullptr};
+    uint64_t countdown = progressInterval(format);
+
+    for (uint64_t record = begin; record < end; record++) {
+
+        reportProgress(handler, countdown, record, format, size);
+        const uint8_t* buf = data + format.header_size + record * format.record_size;
+
+        if (isEndOfData(buf, format.record_size)) {
+            if (++file_ends == 2) {
+                return n_clicks;
+            }
+        } else {
+            file_ends = 0;
+        }
+
+        if (click_pending) {
+            handler.click(pending);
+            click_pending = false;
+            n_clicks++;
+        }
+
+        if (validator && !validator->check(record, buf)) {
+            continue;
+        }
+
+        if (!isCPODMinute(buf, format.record_size)) {
+            if (has_trains) {
+                decodeCPODTrain(buf, format.ext, train);
+            }
+            pending = ClickRef{record, buf, current_min,
+                               has_trains ? &train : nullptr};
+            click_pending = true;
+        } else {
+            current_min++;
+            decodeCPODMinute(buf, env);
+            handler.minute(env);
+        }
+    }
+
+    // at the end of the file, the last "click" is the first of the
+    // end-of-data records, but a range that stops short of that ends with
+    // a real click
+    if (click_pending && end < n_records && file_ends == 0) {
+        handler.click(pending);
+        n_clicks++;
+    }
+    return n_clicks;
+}
+
+} // namespace detail
+
+// decodeRecords: streams through the data records that follow the header, and
+// calls the handler for each of them, in file order:
+// * handler.click(const ClickRef&) for each click
+// * handler.wav(const WavRecord&) for pseudo-wav data, which belongs to the
+//   last click (FPOD only)
+// * handler.minute(const EnvRecord&) for the start of each minute
+// Handlers may also have a progress(uint64_t bytes_done, uint64_t bytes_total)
+// method, which is called about once per MB of records, and at the end (e.g.
+// to check for user interrupts); handlers without it pay nothing for this.
+// data and size are the whole file (including the header). Returns the number
+// of clicks.
+// If errors is given, implausible records are skipped up to the next minute
+// record, and reported in errors; see RecordValidator.
+template<class Handler>
+uint64_t decodeFPODRecords(const uint8_t* data, std::size_t size,
+                           const Format& format, const Header& header,
+                           Handler& handler, std::vector<DecodeError>* errors = nullptr) {
+    if (size < format.header_size) {
+        return 0;
+    }
+    std::unique_ptr<RecordValidator> validator;
+    if (errors) {
+        validator = std::make_unique<RecordValidator>(size, format, header, *errors);
+    }
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+
+    // starting at -1 makes the logic inside the loop a lot nicer
+    uint64_t n_clicks = detail::decodeFPODRange(data, size, format, header, handler,
+                                                0, n_records, -1, validator.get());
+    if (validator) {
+        validator->finish();
+    }
+    detail::reportDone(handler, size);
+    return n_clicks;
+}
+
+template<class Handler>
+uint64_t decodeCPODRecords(const uint8_t* data, std::size_t size,
+                           const Format& format, const Header& header,
+                           Handler& handler, std::vector<DecodeError>* errors = nullptr) {
+    if (size < format.header_size) {
+        return 0;
+    }
+    std::unique_ptr<RecordValidator> validator;
+    if (errors) {
+        validator = std::make_unique<RecordValidator>(size, format, header, *errors);
+    }
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+
+    uint64_t n_clicks = detail::decodeCPODRange(data, size, format, header, handler,
+                                                0, n_records, -1, validator.get());
+    if (validator) {
+        validator->finish();
+    }
+    detail::reportDone(handler, size);
+    return n_clicks;
+}
+
+template<class Handler>
+uint64_t decodeRecords(const uint8_t* data, std::size_t size,
+                       const Format& format, const Header& header,
+                       Handler& handler, std::vector<DecodeError>* errors = nullptr) {
+    if (format.is_cpod()) {
+        return decodeCPODRecords(data, size, format, header, handler, errors);
+    }
+    return decodeFPODRecords(data, size, format, header, handler, errors);
+}
+
+// findMinutes: returns the (0-based) numbers of the minute records in the
+// data, i.e. where each minute starts. This only looks at the byte that
+// identifies each record (and, for CPOD files, at the end-of-data records),
+// which is much faster than decoding the records.
+inline std::vector<uint64_t> findMinutes(const uint8_t* data, std::size_t size,
+                                         const Format& format) {
+    std::vector<uint64_t> minutes;
+    if (size < format.header_size) {
+        return minutes;
+    }
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+    const uint8_t* records = data + format.header_size;
+
+    if (format.is_fpod()) {
+        for (uint64_t record = 0; record < n_records; record++) {
+            if (isFPODMinute(records + record * format.record_size)) {
+                minutes.push_back(record);
+            }
+        }
+        return minutes;
+    }
+
+    int file_ends = 0;
+    for (uint64_t record = 0; record < n_records; record++) {
+        const uint8_t* buf = records + record * format.record_size;
+        if (isCPODMinute(buf, format.record_size)) {
+            minutes.push_back(record);
+            file_ends = 0;
+        } else if (buf[format.record_size - 1] == 255 && isEndOfData(buf, format.record_size)) {
+            if (++file_ends == 2) {
+                break;
+            }
+        } else {
+            file_ends = 0;
+        }
+    }
+    return minutes;
+}
+
+// decodeMinutes: like decodeRecords, but only calls handler.click() and
+// handler.wav() for the records of the given minutes, jumping from one to
+// the next. handler.minute() is still called for every minute. minutes are
+// the (0-based, ascending) numbers of the minutes to decode, and
+// minute_records the result of findMinutes(). The records before the first
+// minute record are skipped. Returns the number of clicks.
+template<class Handler>
+uint64_t decodeMinutes(const uint8_t* data, std::size_t size,
+                       const Format& format, const Header& header, Handler& handler,
+                       const std::vector<uint64_t>& minute_records,
+                       const std::vector<int>& minutes) {
+    if (size < format.header_size) {
+        return 0;
+    }
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+    uint64_t n_clicks = 0;
+    uint64_t next_report = 1 << 20;
+    EnvRecord env;
+    auto selected = minutes.begin();
+
+    for (std::size_t k = 0; k < minute_records.size(); k++) {
+        const uint8_t* buf = data + format.header_size + minute_records[k] * format.record_size;
+        if (format.is_cpod()) {
+            decodeCPODMinute(buf, env);
+        } else {
+            decodeFPODMinute(buf, header.pic_ver, env);
+        }
+        handler.minute(env);
+
+        while (selected != minutes.end() && *selected < static_cast<int>(k)) {
+            selected++;
+        }
+        if (selected == minutes.end() || *selected != static_cast<int>(k)) {
+            continue;
+        }
+
+        uint64_t begin = minute_records[k] + 1;
+        uint64_t end = k + 1 < minute_records.size() ? minute_records[k + 1] : n_records;
+        if (format.is_cpod()) {
+            n_clicks += detail::decodeCPODRange(data, size, format, header, handler,
+                                                begin, end, static_cast<int>(k), nullptr);
+        } else {
+            n_clicks += detail::decodeFPODRange(data, size, format, header, handler,
+                                                begin, end, static_cast<int>(k), nullptr);
+        }
+
+        if constexpr (detail::has_progress<Handler>::value) {
+            uint64_t bytes = format.header_size + end * format.record_size;
+            if (bytes >= next_report) {
+                next_report = bytes + (1 << 20);
+                handler.progress(bytes, size);
+            }
+        }
+    }
+    detail::reportDone(handler, size);
+    return n_clicks;
+}
+
+// RecordCounts: the number of records of each type in a data file
+struct RecordCounts {
+    uint64_t clicks{0};
+    uint64_t trains{0}; // train records (FPOD only; 249)
+    uint64_t wav{0}; // pseudo-wav records (FPOD only; 250)
+    uint64_t minutes{0}; // minute records (254)
+    uint64_t other{0}; // unknown records, and the CPOD end-of-data records
+};
+
+// countRecords: counts the records that follow the header, by type
+inline RecordCounts countRecords(const uint8_t* data, std::size_t size,
+                                 const Format& format) {
+    RecordCounts counts;
+    if (size < format.header_size) {
+        return counts;
+    }
+    uint64_t n_records = (size - format.header_size) / format.record_size;
+
+    for (uint64_t record = 0; record < n_records; record++) {
+        const uint8_t* buf = data + format.header_size + record * format.record_size;
+        if (format.is_cpod()) {
+            if (isEndOfData(buf, format.record_size)) {
+                counts.other++;
+            } else if (isCPODMinute(buf, format.record_size)) {
+                counts.minutes++;
+            } else {
+                counts.clicks++;
+            }
+        } else if (isFPODClick(buf)) {
+            counts.clicks++;
+        } else if (isFPODTrain(buf)) {
+            counts.trains++;
+        } else if (isFPODWav(buf)) {
+            counts.wav++;
+        } else if (isFPODMinute(buf)) {
+            counts.minutes++;
+        } else {
+            counts.other++;
+        }
+    }
+    return counts;
+}
+
+} // namespace fpod
+
+#endif
@@ -0,0 +1,334 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_ENCODER_H
+#define FPOD_INCLUDE_ENCODER_H
+
+#include "records.h"
+#include "header.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // for std::memcpy
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fpod {
+
+// The encode* functions are the inverses of the decode* functions (and of
+// the header parsers): decoding what they write gives back the same values.
+// buf must hold a whole record (or header), and be zero-filled by the caller.
+// Values that can't be stored in the format throw std::invalid_argument.
+
+namespace detail {
+
+template<class T>
+void storeInt(uint8_t* buf, std::size_t offset, std::size_t size, T value) {
+    for (std::size_t i = 0; i < size; i++) {
+        buf[offset + size - 1 - i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline void storeString(uint8_t* buf, std::size_t offset, std::size_t length,
+                        const std::string& value) {
+    std::memcpy(buf + offset, value.data(), std::min(length, value.size()));
+}
+
+inline void checkRange(long long value, long long lo, long long hi, const char* field) {
+    if (value < lo || value > hi) {
+        throw std::invalid_argument(std::string(field) + " out of range: " +
+                                    std::to_string(value));
+    }
+}
+
+// storeMicrosec: stores the time since the start of the minute, in units of 5
+// microseconds, such that getMicrosec() gives back the same value
+inline void storeMicrosec(uint8_t* buf, int microsec, uint32_t max_ticks) {
+    checkRange(microsec, 0, static_cast<long long>(max_ticks) * 5, "microsec");
+    uint32_t ticks = static_cast<uint32_t>(microsec / 5);
+    for (uint32_t t = ticks; t <= ticks + 1; t++) {
+        if (ticksToMicrosec(t) == microsec) {
+            buf[0] = static_cast<uint8_t>(t >> 16);
+            buf[1] = static_cast<uint8_t>(t >> 8);
+            buf[2] = static_cast<uint8_t>(t);
+            return;
+        }
+    }
+    throw std::invalid_argument("microsec can't be encoded: " + std::to_string(microsec));
+}
+
+// speciesCode: the inverse of getSpeciesFromCode
+inline int speciesCode(uint8_t species, std::string_view ext) {
+    if (ext == "CP3") {
+        return species == 0 ? 8 : 2 * (species - 1);
+    }
+    if (species == 0 || species >= species_names.size()) {
+        throw std::invalid_argument("species can't be encoded in " + std::string(ext));
+    }
+    return species - 1;
+}
+
+} // namespace detail
+
+inline void encodeFPODHeader(const Header& header, const Format& format, uint8_t* buf) {
+    using namespace detail;
+    int pod_id = std::stoi(header.pod_id);
+    checkRange(pod_id, 0, 255 * 100 + 99, "pod_id");
+    buf[3] = static_cast<uint8_t>(pod_id / 100);
+    buf[4] = static_cast<uint8_t>(pod_id % 100);
+    storeInt(buf, 256, 4, header.first_logged_min);
+    storeInt(buf, 260, 4, header.last_logged_min);
+    storeInt(buf, 131, 2, header.water_depth);
+    storeInt(buf, 129, 2, header.deployment_depth);
+    storeString(buf, 133, 11, header.lat_text);
+    storeString(buf, 145, 11, header.lon_text);
+    storeString(buf, 157, 30, header.location_text);
+    storeString(buf, 188, 43, header.notes_text);
+    storeString(buf, 232, 11, header.gmt_text);
+    buf[37] = header.pic_ver;
+    storeInt(buf, 39, 2, header.fpga_ver);
+
+    // note that this overlaps with gmt_text
+    if (format.ext == "FP3") {
+        storeInt(buf, 231, 8, header.source_clicks);
+    }
+}
+
+inline void encodeCPODHeader(const Header& header, const Format& format, uint8_t* buf) {
+    using namespace detail;
+    storeString(buf, 164, 4, header.pod_id);
+    storeInt(buf, 256, 4, header.first_logged_min);
+    storeInt(buf, 260, 4, header.last_logged_min);
+    storeInt(buf, 31, 2, header.water_depth);
+    storeInt(buf, 29, 2, header.deployment_depth);
+    storeString(buf, 13, 8, header.lat_text);
+    storeString(buf, 21, 8, header.lon_text);
+    storeString(buf, 33, 31, header.location_text);
+    storeString(buf, 211, 50, header.notes_text);
+
+    if (format.ext == "CP3") {
+        storeInt(buf, 128, 4, static_cast<uint32_t>(header.source_clicks));
+    }
+}
+
+inline void encodeHeader(const Header& header, const Format& format, uint8_t* buf) {
+    if (format.is_cpod()) {
+        encodeCPODHeader(header, format, buf);
+    } else {
+        encodeFPODHeader(header, format, buf);
+    }
+}
+
+inline void encodeFPODClick(const ClickRecord& click, uint8_t* buf) {
+    using namespace detail;
+    // the first byte must stay below 184, which is where the other record
+    // types start
+    storeMicrosec(buf, click.microsec, 184 * 65536 - 1);
+    buf[3] = click.ncyc;
+
+    uint8_t range;
+    if (click.clk_ipi_range == 65) {
+        range = 15;
+    } else if (click.clk_ipi_range < 8) {
+        range = click.clk_ipi_range;
+    } else if (click.clk_ipi_range % 8 == 0 && click.clk_ipi_range <= 56) {
+        range = 8 | (click.clk_ipi_range / 8 - 1);
+    } else {
+        throw std::invalid_argument("clk_ipi_range can't be encoded: " +
+                                    std::to_string(click.clk_ipi_range));
+    }
+    checkRange(click.pkat, 0, 15, "pkat");
+    buf[4] = static_cast<uint8_t>(click.pkat << 4 | range);
+
+    checkRange(click.ipi_pre_max, 1, 256, "ipi_pre_max");
+    checkRange(click.ipi_at_max, 1, 256, "ipi_at_max");
+    buf[5] = static_cast<uint8_t>(click.ipi_pre_max - 1);
+    buf[6] = static_cast<uint8_t>(click.ipi_at_max - 1);
+
+    checkRange(click.amp_at_max, 2, 255, "amp_at_max");
+    buf[10] = click.amp_at_max;
+
+    // duration is stored (times 5) in 12 bits
+    checkRange(click.amp_reversals, 0, 15, "amp_reversals");
+    int duration = static_cast<int>(click.duration) * 5;
+    if (duration != click.duration * 5) {
+        throw std::invalid_argument("duration must be a whole number");
+    }
+    checkRange(duration, 0, 4095, "duration * 5");
+    buf[13] = static_cast<uint8_t>((duration >> 8) << 4 | click.amp_reversals);
+    buf[14] = static_cast<uint8_t>(duration & 0xFF);
+}
+
+// encodeCPODClick: the click, and for CP3, its train data
+inline void encodeCPODClick(const ClickRecord& click, const Format& format, uint8_t* buf) {
+    using namespace detail;
+    storeMicrosec(buf, click.microsec, 0xFFFFFF);
+    buf[3] = click.ncyc;
+    if (click.khz != click.amp_at_max) {
+        throw std::invalid_argument("khz and amp_at_max are the same field in CPOD files");
+    }
+    buf[5] = click.khz;
+
+    if (format.ext == "CP3") {
+        // the last byte of the record (train_id) marks minute records
+        checkRange(click.train_id, 0, 253, "train_id");
+        checkRange(click.quality_level, 0, 3, "quality_level");
+        buf[39] = click.train_id;
+        buf[36] = static_cast<uint8_t>(speciesCode(click.species, format.ext) << 3 |
+                                       click.quality_level);
+    }
+}
+
+inline void encodeClick(const ClickRecord& click, const Format& format, uint8_t* buf) {
+    if (format.is_cpod()) {
+        encodeCPODClick(click, format, buf);
+    } else {
+        encodeFPODClick(click, buf);
+    }
+}
+
+inline void encodeFPODTrain(const TrainRecord& train, std::string_view ext, uint8_t* buf) {
+    using namespace detail;
+    checkRange(train.quality_level, 0, 3, "quality_level");
+    buf[0] = 249;
+    buf[15] = train.train_id;
+    buf[14] = static_cast<uint8_t>(speciesCode(train.species, ext) << 2 |
+                                   train.quality_level | (train.echo ? 32 : 0));
+}
+
+inline void encodeFPODWav(const WavRecord& wav, uint8_t* buf) {
+    buf[0] = 250;
+    int j = 0;
+    for (int pos = 12; pos >= 0; pos -= 2) {
+        buf[pos+1] = wav.ipi[j];
+        buf[pos+2] = wav.spl[j];
+        j++;
+    }
+}
+
+inline void encodeFPODMinute(const EnvRecord& env, int pic_ver, uint8_t* buf) {
+    using namespace detail;
+    checkRange(env.temp_deg_c, 0, 255, "temp_deg_c");
+    checkRange(env.angle, 0, 255, "angle");
+    checkRange(env.bat1, 0, 255, "bat1");
+    checkRange(env.bat2, 0, 255, "bat2");
+    buf[0] = 254;
+    buf[3] = static_cast<uint8_t>(env.angle);
+    buf[7] = static_cast<uint8_t>(env.temp_deg_c);
+    buf[10] = static_cast<uint8_t>((env.prior_min ? 1 : 0) | (env.bat_use == 2 ? 2 : 0) |
+                                   (env.next_min ? 4 : 0));
+
+    // older firmware stores the battery voltages one byte later if the first
+    // one is zero
+    if (pic_ver < 28 && env.bat1 == 0) {
+        buf[12] = 0;
+        buf[13] = static_cast<uint8_t>(env.bat2);
+    } else {
+        buf[11] = static_cast<uint8_t>(env.bat1);
+        buf[12] = static_cast<uint8_t>(env.bat2);
+    }
+}
+
+// encodeCPODMinute: in CPOD minute records, the temperature and angle are
+// derived from the battery bytes, so only bat1 and bat2 are stored
+inline void encodeCPODMinute(const EnvRecord& env, const Format& format, uint8_t* buf) {
+    using namespace detail;
+    checkRange(env.bat1, 0, 255, "bat1");
+    checkRange(env.bat2, 0, 255, "bat2");
+    buf[3] = static_cast<uint8_t>(env.bat1);
+    buf[4] = static_cast<uint8_t>(env.bat2);
+    buf[format.record_size - 1] = 254;
+}
+
+// RecordWriter: writes a data file, one record at a time, through a buffer
+class RecordWriter {
+public:
+    RecordWriter(const std::string& path, const Format& m_format) :
+        format(m_format), out(path, std::ios::binary), record(m_format.record_size) {
+        buffer.reserve(buffer_size);
+    }
+
+    ~RecordWriter() {
+        flush();
+    }
+
+    bool is_open() const { return out.is_open(); }
+
+    void header(const Header& h) {
+        std::vector<uint8_t> buf(format.header_size);
+        encodeHeader(h, format, buf.data());
+        write(buf.data(), buf.size());
+    }
+
+    void click(const ClickRecord& click) {
+        encodeClick(click, format, clear());
+        write(record.data(), record.size());
+    }
+
+    void train(const TrainRecord& train) {
+        encodeFPODTrain(train, format.ext, clear());
+        write(record.data(), record.size());
+    }
+
+    void wav(const WavRecord& wav) {
+        encodeFPODWav(wav, clear());
+        write(record.data(), record.size());
+    }
+
+    void minute(const EnvRecord& env, int pic_ver) {
+        if (format.is_cpod()) {
+            encodeCPODMinute(env, format, clear());
+        } else {
+            encodeFPODMinute(env, pic_ver, clear());
+        }
+        write(record.data(), record.size());
+    }
+
+    // end: marks the end of the data (CPOD only)
+    void end() {
+        if (format.is_cpod()) {
+            std::fill(record.begin(), record.end(), 255);
+            write(record.data(), record.size());
+            write(record.data(), record.size());
+        }
+    }
+
+    // flush: writes the buffer to the file, and returns false on errors
+    bool flush() {
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        buffer.clear();
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+private:
+    static const std::size_t buffer_size = 1 << 20;
+
+    uint8_t* clear() {
+        std::fill(record.begin(), record.end(), 0);
+        return record.data();
+    }
+
+    void write(const uint8_t* data, std::size_t size) {
+        if (buffer.size() + size > buffer_size) {
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            buffer.clear();
+        }
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    Format format;
+    std::ofstream out;
+    std::vector<uint8_t> record;
+    std::vector<uint8_t> buffer;
+};
+
+} // namespace fpod
+
+#endif
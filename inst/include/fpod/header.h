@@ -0,0 +1,116 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_HEADER_H
+#define FPOD_INCLUDE_HEADER_H
+
+#include "records.h" // for Format
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fpod {
+
+// Header: the metadata in the file header. Fields that are not stored in
+// files of a given type are left at their defaults.
+struct Header {
+    std::string pod_id; // the pod number (FPOD) or name (CPOD)
+    int32_t first_logged_min{0}; // minutes since 1900-01-01 00:00
+    int32_t last_logged_min{0};
+    int water_depth{0};
+    int deployment_depth{0};
+    std::string lat_text;
+    std::string lon_text;
+    std::string location_text;
+    std::string notes_text;
+    std::string gmt_text; // (FPOD only)
+    uint8_t pic_ver{0}; // (FPOD only)
+    int fpga_ver{0}; // (FPOD only)
+    bool extended_amps{false}; // (FPOD only)
+    int64_t source_clicks{0}; // clicks in the FP1/CP1 file (FP3/CP3 only)
+};
+
+namespace detail {
+
+// constructInt: combines size bytes from offset (big-endian) into an integer
+template<class T>
+T constructInt(const uint8_t* buf, std::size_t buf_size, std::size_t offset,
+               std::size_t size) {
+    T res = 0;
+    if (offset+size < buf_size) {
+        for (std::size_t i = 0; i < size; i++) {
+            res <<= 8;
+            res |= static_cast<T>(buf[offset+i]);
+        }
+    }
+    return res;
+}
+
+// parseString: combines length bytes from offset into a string
+inline std::string parseString(const uint8_t* buf, std::size_t offset,
+                               std::size_t length) {
+    return std::string(reinterpret_cast<const char*>(buf + offset), length);
+}
+
+} // namespace detail
+
+// parseFPODHeader/parseCPODHeader: parse the header at buf, which must hold
+// (at least) format.header_size bytes
+inline Header parseFPODHeader(const uint8_t* buf, const Format& format) {
+    using namespace detail;
+    std::size_t size = format.header_size;
+
+    Header header;
+    header.pod_id = std::to_string(100 * buf[3] + buf[4]);
+    header.first_logged_min = constructInt<int32_t>(buf, size, 256, 4);
+    header.last_logged_min = constructInt<int32_t>(buf, size, 260, 4);
+    header.water_depth = (buf[131] << 8) + buf[132];
+    header.deployment_depth = (buf[129] << 8) + buf[130];
+    header.lat_text = parseString(buf, 133, 11);
+    header.lon_text = parseString(buf, 145, 11);
+    header.location_text = parseString(buf, 157, 30);
+    header.notes_text = parseString(buf, 188, 43);
+    header.gmt_text = parseString(buf, 232, 11);
+    header.pic_ver = buf[37];
+    header.fpga_ver = buf[39] << 8 | buf[40];
+    header.extended_amps = header.fpga_ver > 0;
+
+    if (format.ext == "FP3") {
+        header.source_clicks = constructInt<int64_t>(buf, size, 231, 8);
+    }
+    return header;
+}
+
+inline Header parseCPODHeader(const uint8_t* buf, const Format& format) {
+    using namespace detail;
+    std::size_t size = format.header_size;
+
+    Header header;
+    header.pod_id = parseString(buf, 164, 4);
+    header.first_logged_min = constructInt<int32_t>(buf, size, 256, 4);
+    header.last_logged_min = constructInt<int32_t>(buf, size, 260, 4);
+    header.water_depth = (buf[31] << 8) | buf[32];
+    header.deployment_depth = (buf[29] << 8) | buf[30];
+    header.lat_text = parseString(buf, 13, 8);
+    header.lon_text = parseString(buf, 21, 8);
+    header.location_text = parseString(buf, 33, 31);
+    header.notes_text = parseString(buf, 211, 50);
+
+    if (format.ext == "CP3") {
+        header.source_clicks = constructInt<uint32_t>(buf, size, 128, 4);
+    }
+    return header;
+}
+
+inline Header parseHeader(const uint8_t* buf, const Format& format) {
+    return format.is_cpod() ? parseCPODHeader(buf, format) : parseFPODHeader(buf, format);
+}
+
+} // namespace fpod
+
+#endif
@@ -0,0 +1,184 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_MAPPED_FILE_H
+#define FPOD_INCLUDE_MAPPED_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace fpod {
+
+// MappedFile: a read-only memory mapping of a whole file. Check is_open()
+// after construction; the mapping is released when the object is destroyed.
+//
+// The implementation is only compiled where FPOD_MAPPED_FILE_IMPLEMENTATION
+// is defined before including this header, which must be done in exactly one
+// source file. That file must not include the R headers, since the Windows
+// implementation needs windows.h, which clashes with them.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return open; }
+    const uint8_t* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    bool open{false};
+    const uint8_t* bytes{nullptr};
+    std::size_t length{0};
+#ifdef _WIN32
+    void* file_handle{nullptr};
+    void* mapping_handle{nullptr};
+#endif
+};
+
+// prefetchFile: asks the operating system to start reading the whole file
+// into the page cache, and returns without waiting for it, so that a later
+// MappedFile of it doesn't wait for the disk. Returns false if the file
+// can't be opened, or if prefetching isn't supported (e.g. on Windows).
+bool prefetchFile(const std::string& path);
+
+} // namespace fpod
+
+#ifdef FPOD_MAPPED_FILE_IMPLEMENTATION
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h> // for open()
+#include <sys/mman.h> // for mmap()
+#include <sys/stat.h> // for fstat()
+#include <unistd.h> // for close()
+#endif
+
+namespace fpod {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return;
+    }
+
+    file_handle = file;
+    open = true;
+    length = static_cast<std::size_t>(file_size.QuadPart);
+
+    // empty files can't be mapped, but are still valid (and empty)
+    if (length == 0) {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        open = false;
+        return;
+    }
+    mapping_handle = mapping;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        open = false;
+        return;
+    }
+    bytes = static_cast<const uint8_t*>(view);
+}
+
+bool prefetchFile(const std::string&) {
+    return false;
+}
+
+MappedFile::~MappedFile() {
+    if (bytes != nullptr) {
+        UnmapViewOfFile(bytes);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        return;
+    }
+
+    length = static_cast<std::size_t>(st.st_size);
+    open = true;
+
+    // empty files can't be mapped, but are still valid (and empty)
+    if (length > 0) {
+        void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            open = false;
+            length = 0;
+        } else {
+            bytes = static_cast<const uint8_t*>(addr);
+        }
+    }
+
+    // the mapping stays valid after the file is closed
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes != nullptr) {
+        munmap(const_cast<uint8_t*>(bytes), length);
+    }
+}
+
+bool prefetchFile(const std::string& path) {
+#ifdef POSIX_FADV_WILLNEED
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    // this queues the reads (readahead) and returns; the page cache keeps
+    // the data after the file is closed
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void) path;
+    return false;
+#endif
+}
+
+#endif
+
+} // namespace fpod
+
+#endif // FPOD_MAPPED_FILE_IMPLEMENTATION
+
+#endif
@@ -0,0 +1,149 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_OVERVIEW_H
+#define FPOD_INCLUDE_OVERVIEW_H
+
+#include "records.h"
+#include "header.h"
+#include "decoder.h"
+#include <algorithm> // for std::max
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace fpod {
+
+// OverviewBin: the summary of the clicks and env data in a bin of minutes
+struct OverviewBin {
+    int minutes{0}; // minute records in the bin
+    uint64_t clicks{0};
+    std::array<uint64_t, 5> species{}; // clicks per species group (index into species_names)
+    double amp_max{0};
+    double amp_median{0};
+    double khz_sum{0};
+    double temp_sum{0};
+    double angle_sum{0};
+    double bat1_sum{0};
+    double bat2_sum{0};
+};
+
+// Overview: a decodeRecords() handler that summarises a file in bins of
+// bin_minutes minutes, without keeping the clicks. Amplitudes and frequencies
+// are mapped through lookup tables (indexed by the raw value), which default
+// to the raw values themselves: FPOD clicks look up the frequency by the IPI
+// (ipi_at_max, or ipi_pre_max for FPGA versions up to 801, minus 1), and the
+// amplitude by the raw amplitude (minus 1), as in the R package; angles are
+// looked up by the raw angle. The amplitude table must be non-decreasing.
+class Overview {
+public:
+    Overview(const Format& m_format, const Header& header, int m_bin_minutes) :
+        format(m_format), bin_minutes(std::max(1, m_bin_minutes)),
+        use_ipi_at_max(header.fpga_ver > 801) {
+        for (int i = 0; i < 256; i++) {
+            khz_table[i] = i;
+            amp_table[i] = i;
+            angle_table[i] = i;
+        }
+    }
+
+    std::array<double, 256> khz_table;
+    std::array<double, 256> amp_table;
+    std::array<double, 256> angle_table;
+    std::vector<OverviewBin> bins;
+
+    void click(const ClickRef& ref) {
+        if (ref.minute < 0) {
+            return; // before the first minute record
+        }
+        std::size_t bin = static_cast<std::size_t>(ref.minute / bin_minutes);
+        if (bin != open_bin) {
+            closeBin();
+            open_bin = bin;
+        }
+        grow(bin);
+
+        ClickRecord click;
+        decodeClick(ref.data, format, click);
+        int raw_amp = click.amp_at_max;
+        double khz = click.khz;
+        if (format.is_fpod()) {
+            int ipi = use_ipi_at_max ? click.ipi_at_max : click.ipi_pre_max;
+            khz = khz_table[ipi - 1];
+            raw_amp -= 1;
+        }
+
+        OverviewBin& b = bins[bin];
+        b.clicks++;
+        b.species[ref.train ? ref.train->species : 0]++;
+        b.khz_sum += khz;
+        b.amp_max = std::max(b.amp_max, amp_table[raw_amp]);
+        amp_counts[raw_amp]++;
+    }
+
+    void wav(const WavRecord&) {}
+
+    void minute(const EnvRecord& env) {
+        current_min++;
+        std::size_t bin = static_cast<std::size_t>(current_min / bin_minutes);
+        grow(bin);
+        OverviewBin& b = bins[bin];
+        b.minutes++;
+        b.temp_sum += env.temp_deg_c;
+        b.angle_sum += angle_table[env.angle & 0xFF];
+        b.bat1_sum += env.bat1;
+        b.bat2_sum += env.bat2;
+    }
+
+    // finish: must be called after decoding, to complete the last bin
+    void finish() {
+        closeBin();
+    }
+
+private:
+    void grow(std::size_t bin) {
+        if (bins.size() <= bin) {
+            bins.resize(bin + 1);
+        }
+    }
+
+    // closeBin: works out the median amplitude of the open bin from the
+    // histogram of its raw amplitudes, and clears the histogram
+    void closeBin() {
+        if (open_bin >= bins.size() || bins[open_bin].clicks == 0) {
+            return;
+        }
+        OverviewBin& b = bins[open_bin];
+        uint64_t lo = (b.clicks - 1) / 2, hi = b.clicks / 2; // 0-based middle ranks
+        double lo_value = 0, hi_value = 0;
+        uint64_t seen = 0;
+        for (int i = 0; i < 256; i++) {
+            if (seen <= lo && lo < seen + amp_counts[i]) {
+                lo_value = amp_table[i];
+            }
+            if (seen <= hi && hi < seen + amp_counts[i]) {
+                hi_value = amp_table[i];
+                break;
+            }
+            seen += amp_counts[i];
+        }
+        b.amp_median = (lo_value + hi_value) / 2;
+        amp_counts.fill(0);
+    }
+
+    Format format;
+    int bin_minutes;
+    bool use_ipi_at_max;
+    int current_min{-1};
+    std::size_t open_bin{static_cast<std::size_t>(-1)};
+    std::array<uint64_t, 256> amp_counts{};
+};
+
+} // namespace fpod
+
+#endif
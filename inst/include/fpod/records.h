@@ -0,0 +1,244 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_RECORDS_H
+#define FPOD_INCLUDE_RECORDS_H
+
+#include <algorithm> // for std::max, std::count
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fpod {
+
+// Format: the file type (upper-case file extension), and the sizes of the
+// header and of each data record in files of that type
+struct Format {
+    std::string ext;
+    std::size_t header_size;
+    std::size_t record_size;
+
+    bool is_cpod() const { return ext == "CP1" || ext == "CP3"; }
+    bool is_fpod() const { return ext == "FP1" || ext == "FP3"; }
+};
+
+// getFormat: returns the format of files with the given extension. Unknown
+// extensions are treated as FPOD files (check is_cpod()/is_fpod()).
+inline Format getFormat(std::string_view ext) {
+    if (ext == "CP1") {
+        return {std::string(ext), 360, 10};
+    } else if (ext == "CP3") {
+        return {std::string(ext), 720, 40};
+    }
+    return {std::string(ext), 1024, 16};
+}
+
+// species groups. The species fields store the index into this list.
+inline const std::vector<std::string> species_names = {
+    "", "NBHF", "OtherCet", "Unclassed", "Sonar"
+};
+
+// getSpeciesFromCode: maps FPOD species code to species groups
+inline uint8_t getSpeciesFromCode(const uint8_t code, std::string_view ext) {
+    // CPOD codes come in pairs: 0-1 NBHF, 2-3 OtherCet, 4-5 Unclassed, 6-7 Sonar
+    if (ext == "CP3" && code <= 7) {
+        return static_cast<uint8_t>(code / 2 + 1);
+    } else if (ext == "FP3" && code <= 3) {
+        return static_cast<uint8_t>(code + 1);
+    }
+    return 0;
+}
+
+// ClickRecord: the fields of a single click data record
+struct ClickRecord {
+    int microsec{0};
+    uint8_t ncyc{0};
+    uint8_t pkat{0};
+    uint8_t clk_ipi_range{0};
+    uint16_t ipi_pre_max{0};
+    uint16_t ipi_at_max{0};
+    uint8_t khz{0};
+    uint8_t amp_at_max{0};
+    uint8_t amp_reversals{0};
+    double duration{0};
+
+    // train data (CP3 only; FP3 train data is stored in separate records)
+    uint8_t train_id{0};
+    uint8_t species{0}; // index into species_names
+    uint8_t quality_level{0};
+};
+
+// TrainRecord: the KERNO classification of a click. In FP3 files, this is a
+// separate record that precedes the click; in CP3 files, it is part of the
+// click record.
+struct TrainRecord {
+    uint8_t train_id{0};
+    uint8_t species{0}; // index into species_names
+    uint8_t quality_level{0};
+    bool echo{false};
+};
+
+// WavRecord: seven cycles of pseudo-wav data (inter-peak-interval and raw
+// amplitude) of the click that precedes it (FPOD only)
+struct WavRecord {
+    uint8_t ipi[7];
+    uint8_t spl[7];
+};
+
+// EnvRecord: the environmental data in a minute record
+struct EnvRecord {
+    int temp_deg_c{0};
+    int angle{0};
+    int bat1{0};
+    int bat2{0};
+    int bat_use{1};
+    bool prior_min{true};
+    bool next_min{false};
+};
+
+namespace detail {
+
+// ticksToMicrosec: converts units of 5 microseconds to microseconds. Note
+// that the rounding error of the division means that about 1% of the ticks
+// come out one microsecond short.
+inline int ticksToMicrosec(uint32_t ticks) {
+    double microsec_d = static_cast<double>(ticks / 200.0 * 1000.0);
+    return static_cast<int>(microsec_d);
+}
+
+// getMicrosec: the first three bytes of a click record hold the time since the
+// start of the minute, in units of 5 microseconds
+inline int getMicrosec(const uint8_t* buf) {
+    uint32_t ticks = buf[0] << 16 | buf[1] << 8 | buf[2];
+    return ticksToMicrosec(ticks);
+}
+
+} // namespace detail
+
+// isClickRecord/isMinuteRecord: record types. FPOD records are identified by
+// their first byte, CPOD records by their last.
+inline bool isFPODClick(const uint8_t* buf) { return buf[0] < 184; }
+inline bool isFPODTrain(const uint8_t* buf) { return buf[0] == 249; }
+inline bool isFPODWav(const uint8_t* buf) { return buf[0] == 250; }
+inline bool isFPODMinute(const uint8_t* buf) { return buf[0] == 254; }
+inline bool isCPODMinute(const uint8_t* buf, std::size_t size) {
+    return buf[size - 1] == 254;
+}
+
+// isEndOfData: CPOD files end with two records where all (or nearly all)
+// bytes are 255
+inline bool isEndOfData(const uint8_t* buf, std::size_t size) {
+    std::size_t count = std::count(buf, buf + size, static_cast<uint8_t>(255));
+    return count >= size - 5;
+}
+
+// decode*: decode the record at buf
+
+inline void decodeFPODClick(const uint8_t* buf, ClickRecord& click) {
+    click.microsec = detail::getMicrosec(buf);
+    click.ncyc = buf[3];
+    click.pkat = (buf[4] & 0xF0) >> 4;
+    if ((buf[4] & 0xF) == 15) {
+        click.clk_ipi_range = 65;
+    } else if ((buf[4] & 0x8) == 8) {
+        click.clk_ipi_range = (((buf[4] & 0x7) + 1) << 3);
+    } else {
+        click.clk_ipi_range = (buf[4] & 0x7);
+    }
+    click.ipi_pre_max = buf[5] + 1;
+    click.ipi_at_max = buf[6] + 1;
+    click.amp_at_max = std::max(static_cast<uint8_t>(2), buf[10]);
+    click.amp_reversals = buf[13] & 15;
+    click.duration = ((buf[13] & 240) * 16 + buf[14])/5;
+}
+
+inline void decodeCPODClick(const uint8_t* buf, std::string_view ext, ClickRecord& click) {
+    click.microsec = detail::getMicrosec(buf);
+    click.ncyc = buf[3];
+    click.khz = buf[5];
+    click.amp_at_max = buf[5];
+
+    // clicks without a frequency have no duration
+    click.duration = buf[5] > 0 ?
+        static_cast<double>(buf[3]) / static_cast<double>(buf[5]) : 0;
+
+    if (ext == "CP3") {
+        click.train_id = buf[39];
+        click.species = getSpeciesFromCode(buf[36] >> 3, ext);
+        click.quality_level = buf[36] & 3;
+    }
+}
+
+// decodeClick: decodes a click record of either format
+inline void decodeClick(const uint8_t* buf, const Format& format, ClickRecord& click) {
+    if (format.is_cpod()) {
+        decodeCPODClick(buf, format.ext, click);
+    } else {
+        decodeFPODClick(buf, click);
+    }
+}
+
+inline void decodeFPODTrain(const uint8_t* buf, std::string_view ext, TrainRecord& train) {
+    train.train_id = buf[15]; // 1 to 255
+    train.species = getSpeciesFromCode((buf[14] >> 2) & 3, ext);
+    train.quality_level = buf[14] & 3;
+    train.echo = (buf[14] & 32) == 32;
+}
+
+inline void decodeCPODTrain(const uint8_t* buf, std::string_view ext, TrainRecord& train) {
+    train.train_id = buf[39];
+    train.species = getSpeciesFromCode(buf[36] >> 3, ext);
+    train.quality_level = buf[36] & 3;
+    train.echo = false;
+}
+
+inline void decodeFPODWav(const uint8_t* buf, WavRecord& wav) {
+    int j = 0;
+    for (int pos = 12; pos >= 0; pos -= 2) {
+        wav.ipi[j] = buf[pos+1];
+        wav.spl[j] = buf[pos+2];
+        j++;
+    }
+}
+
+// decodeFPODMinute: pic_ver is the PIC firmware version from the file header,
+// which determines where the battery voltages are stored
+inline void decodeFPODMinute(const uint8_t* buf, int pic_ver, EnvRecord& env) {
+    env.temp_deg_c = static_cast<int>(buf[7]);
+    env.angle = buf[3];
+
+    if (pic_ver < 28 && buf[11] == 0 && buf[13]) {
+        env.bat1 = buf[12];
+        env.bat2 = buf[13];
+    } else {
+        env.bat1 = buf[11];
+        env.bat2 = buf[12];
+    }
+
+    env.bat_use = (buf[10] & 2) == 0 ? 1 : 2;
+    env.prior_min = buf[10] & 1;
+    env.next_min = (buf[10] >> 2) & 1;
+}
+
+inline void decodeCPODMinute(const uint8_t* buf, EnvRecord& env) {
+    env.angle = buf[4];
+    env.temp_deg_c = (buf[3]+2) / 5; // +2 to round to nearest int
+    env.bat1 = buf[3];
+    env.bat2 = buf[4];
+
+    // hard-coded defaults for now
+    env.prior_min = true;
+    env.next_min = false; // not used for cpod
+    env.bat_use = 1; // not used for cpod
+}
+
+} // namespace fpod
+
+#endif
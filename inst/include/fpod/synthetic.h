@@ -0,0 +1,169 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_SYNTHETIC_H
+#define FPOD_INCLUDE_SYNTHETIC_H
+
+#include "encoder.h"
+#include <cmath> // for std::log
+#include <cstdint>
+#include <string>
+
+namespace fpod {
+
+// SyntheticOptions: the shape of a synthetic data file
+struct SyntheticOptions {
+    int64_t minutes{1440}; // number of minute records
+    double click_rate{100}; // mean number of clicks per minute
+    double train_density{0.5}; // fraction of clicks with a classification (FP3/CP3)
+    double wav_density{0.05}; // fraction of clicks with pseudo-wav data (FPOD)
+    uint64_t seed{1};
+};
+
+namespace detail {
+
+// Random: a small, fast random number generator (splitmix64). Unlike the
+// standard library distributions, it gives the same numbers on every
+// platform, so a seed always gives the same file.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform: a number in [0, 1)
+    double uniform() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+    // integer: a number in [lo, hi]
+    int integer(int lo, int hi) {
+        return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+    // exponential: an exponentially distributed number with the given mean
+    double exponential(double mean) {
+        return -mean * std::log1p(-uniform());
+    }
+
+private:
+    uint64_t state;
+};
+
+} // namespace detail
+
+// writeSynthetic: writes a data file with random (but valid) records: for
+// each minute, a minute record followed by the clicks of that minute (at
+// exponentially distributed intervals), each preceded by train data and
+// followed by pseudo-wav data as given by the densities. Returns the number
+// of clicks written, or -1 if the file couldn't be written.
+inline int64_t writeSynthetic(const std::string& path, const Format& format,
+                              const Header& header, const SyntheticOptions& options) {
+    RecordWriter writer(path, format);
+    if (!writer.is_open()) {
+        return -1;
+    }
+    writer.header(header);
+
+    detail::Random random(options.seed);
+    bool has_trains = format.ext == "FP3" || format.ext == "CP3";
+    bool has_wav = format.is_fpod();
+    double mean_interval = options.click_rate > 0 ? 60e6 / options.click_rate : 0;
+    int64_t n_clicks = 0;
+
+    EnvRecord env;
+    env.temp_deg_c = 10;
+    env.bat1 = 200;
+    env.bat2 = 200;
+
+    ClickRecord click;
+    TrainRecord train;
+    WavRecord wav;
+
+    for (int64_t min = 0; min < options.minutes; min++) {
+
+        // environmental data drifts slowly
+        if (random.uniform() < 0.01) {
+            env.temp_deg_c = std::max(0, std::min(40, env.temp_deg_c + random.integer(-1, 1)));
+        }
+        env.angle = random.integer(0, 90);
+        if (format.is_cpod()) {
+            // CPOD minute records derive the angle from the battery bytes
+            env.bat2 = env.angle;
+        }
+        writer.minute(env, header.pic_ver);
+
+        if (mean_interval <= 0) {
+            continue;
+        }
+
+        double microsec = random.exponential(mean_interval);
+        while (microsec < 60e6) {
+            click.microsec = detail::ticksToMicrosec(static_cast<uint32_t>(microsec / 5));
+            click.ncyc = static_cast<uint8_t>(random.integer(2, 40));
+
+            if (format.is_cpod()) {
+                click.khz = static_cast<uint8_t>(random.integer(20, 160));
+                click.amp_at_max = click.khz;
+            } else {
+                click.pkat = static_cast<uint8_t>(random.integer(0, std::min(15, click.ncyc - 1)));
+                click.clk_ipi_range = static_cast<uint8_t>(random.integer(0, 7));
+                click.ipi_pre_max = static_cast<uint16_t>(random.integer(10, 120));
+                click.ipi_at_max = static_cast<uint16_t>(random.integer(10, 120));
+                click.amp_at_max = static_cast<uint8_t>(random.integer(2, 255));
+                click.amp_reversals = static_cast<uint8_t>(random.integer(0, 15));
+                click.duration = random.integer(0, 819);
+            }
+
+            bool classified = has_trains && random.uniform() < options.train_density;
+            if (classified) {
+                train.train_id = static_cast<uint8_t>(random.integer(1, 253));
+                train.species = static_cast<uint8_t>(random.uniform() < 0.7 ? 1 : random.integer(2, 4));
+                train.quality_level = static_cast<uint8_t>(random.integer(0, 3));
+                train.echo = format.is_fpod() && random.uniform() < 0.05;
+            } else {
+                train = TrainRecord();
+            }
+
+            if (format.is_cpod()) {
+                click.train_id = train.train_id;
+                click.species = train.species;
+                click.quality_level = train.quality_level;
+            } else if (classified) {
+                writer.train(train);
+            }
+            writer.click(click);
+            n_clicks++;
+
+            if (has_wav && random.uniform() < options.wav_density) {
+                int n_wav = random.integer(1, 3);
+                for (int k = 0; k < n_wav; k++) {
+                    for (int j = 0; j < 7; j++) {
+                        wav.ipi[j] = static_cast<uint8_t>(random.integer(10, 120));
+                        wav.spl[j] = static_cast<uint8_t>(random.integer(0, 255));
+                    }
+                    writer.wav(wav);
+                }
+            }
+
+            microsec += random.exponential(mean_interval);
+        }
+    }
+
+    writer.end();
+    return writer.flush() ? n_clicks : -1;
+}
+
+} // namespace fpod
+
+#endif
@@ -0,0 +1,153 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_INCLUDE_VALIDATOR_H
+#define FPOD_INCLUDE_VALIDATOR_H
+
+#include "records.h"
+#include "header.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fpod {
+
+// DecodeError: a problem found by a validating decode, usually a stretch of
+// implausible records that was skipped. Problems with the file as a whole
+// (e.g. the header) have n_records = 0.
+struct DecodeError {
+    uint64_t record; // the first record skipped (0-based, after the header)
+    uint64_t n_records; // the number of records skipped
+    int minute; // the number of minute records before it
+    std::string reason;
+};
+
+namespace detail {
+
+// the largest time in a click record, in units of 5 microseconds
+constexpr uint32_t max_click_ticks = 60 * 200000 - 1;
+
+inline uint32_t getTicks(const uint8_t* buf) {
+    return buf[0] << 16 | buf[1] << 8 | buf[2];
+}
+
+} // namespace detail
+
+// RecordValidator: checks the records of a file as they are decoded, and
+// decides which ones to skip. A record is implausible if:
+// * it is of no known type (FPOD)
+// * it is a click with a time beyond the end of the minute, or before the
+//   previous click in the same minute
+// * it is a minute record beyond the logged minutes in the header
+// After an implausible record, all records are skipped until the next minute
+// record, where decoding resumes (except after a minute overrun, which skips
+// the rest of the file). Note that the minute records lost in a skipped
+// stretch can't be recovered, so later minutes come out early.
+class RecordValidator {
+public:
+    RecordValidator(std::size_t size, const Format& m_format,
+                    const Header& header, std::vector<DecodeError>& m_errors) :
+        format(m_format), errors(m_errors) {
+        if (header.last_logged_min < header.first_logged_min) {
+            errors.push_back({0, 0, 0, "invalid header: last_logged_min before first_logged_min"});
+        } else if (header.last_logged_min > header.first_logged_min) {
+            // files written by different programs count the last minute
+            // inclusively or not, so allow for one more
+            max_minutes = static_cast<int64_t>(header.last_logged_min) -
+                header.first_logged_min + 1;
+        }
+        if (size > format.header_size) {
+            trailing_bytes = (size - format.header_size) % format.record_size;
+            n_records = (size - format.header_size) / format.record_size;
+        }
+    }
+
+    // check: returns true if the record should be decoded, or false if it is
+    // skipped (and reported)
+    bool check(uint64_t record, const uint8_t* buf) {
+        if (skipping && !overrun && isMinute(buf)) {
+            skipping = false;
+        }
+        if (skipping) {
+            errors.back().n_records++;
+            return false;
+        }
+
+        const char* reason = problem(buf);
+        if (reason) {
+            errors.push_back({record, 1, minutes - (isMinute(buf) ? 1 : 0), reason});
+            skipping = true;
+            return false;
+        }
+        return true;
+    }
+
+    // finish: reports the problems that are only known at the end
+    void finish() {
+        if (trailing_bytes > 0) {
+            errors.push_back({n_records, 0, minutes,
+                              "truncated record: " + std::to_string(trailing_bytes) +
+                              " bytes after the last whole record"});
+        }
+    }
+
+private:
+    bool isMinute(const uint8_t* buf) const {
+        return format.is_cpod() ? isCPODMinute(buf, format.record_size) : isFPODMinute(buf);
+    }
+
+    // problem: the reason the record is implausible, or nullptr
+    const char* problem(const uint8_t* buf) {
+        if (isMinute(buf)) {
+            if (++minutes > max_minutes && max_minutes > 0) {
+                overrun = true;
+                return "minute overrun: more minute records than logged minutes in the header";
+            }
+            last_ticks = 0;
+            return nullptr;
+        }
+
+        // files end with one or two records of (nearly) all 255s, which the
+        // decoder skips or stops at
+        if (isEndOfData(buf, format.record_size)) {
+            return nullptr;
+        }
+
+        bool is_click = format.is_cpod() || isFPODClick(buf);
+        if (!is_click && !isFPODTrain(buf) && !isFPODWav(buf)) {
+            return "unknown record type";
+        }
+
+        if (is_click) {
+            uint32_t ticks = detail::getTicks(buf);
+            if (ticks > detail::max_click_ticks) {
+                return "click time beyond the end of the minute";
+            }
+            if (ticks < last_ticks) {
+                return "click time before the previous click";
+            }
+            last_ticks = ticks;
+        }
+        return nullptr;
+    }
+
+    Format format;
+    std::vector<DecodeError>& errors;
+    int64_t max_minutes{0}; // 0 if unknown
+    int minutes{0}; // minute records so far
+    uint32_t last_ticks{0}; // the time of the last click in this minute
+    bool skipping{false};
+    bool overrun{false};
+    std::size_t trailing_bytes{0};
+    uint64_t n_records{0};
+};
+
+} // namespace fpod
+
+#endif
@@ -10,24 +10,310 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// exportArrow
+void exportArrow(Rcpp::List x, double n, SEXP array_ptr, SEXP schema_ptr);
+RcppExport SEXP _fpod_exportArrow(SEXP xSEXP, SEXP nSEXP, SEXP array_ptrSEXP, SEXP schema_ptrSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type n(nSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type array_ptr(array_ptrSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type schema_ptr(schema_ptrSEXP);
+    exportArrow(x, n, array_ptr, schema_ptr);
+    return R_NilValue;
+END_RCPP
+}
+// writeCache
+void writeCache(const std::string path, Rcpp::RawVector meta, Rcpp::List columns);
+RcppExport SEXP _fpod_writeCache(SEXP pathSEXP, SEXP metaSEXP, SEXP columnsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type meta(metaSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type columns(columnsSEXP);
+    writeCache(path, meta, columns);
+    return R_NilValue;
+END_RCPP
+}
+// openCache
+Rcpp::List openCache(const std::string path);
+RcppExport SEXP _fpod_openCache(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(openCache(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// mappedString
+SEXP mappedString(SEXP codes, SEXP levels);
+RcppExport SEXP _fpod_mappedString(SEXP codesSEXP, SEXP levelsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type codes(codesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type levels(levelsSEXP);
+    rcpp_result_gen = Rcpp::wrap(mappedString(codes, levels));
+    return rcpp_result_gen;
+END_RCPP
+}
+// compressColumn
+SEXP compressColumn(SEXP x);
+RcppExport SEXP _fpod_compressColumn(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(compressColumn(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// compressTime
+SEXP compressTime(SEXP time, SEXP microsec);
+RcppExport SEXP _fpod_compressTime(SEXP timeSEXP, SEXP microsecSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type microsec(microsecSEXP);
+    rcpp_result_gen = Rcpp::wrap(compressTime(time, microsec));
+    return rcpp_result_gen;
+END_RCPP
+}
+// lazyLookup
+SEXP lazyLookup(SEXP x, SEXP table);
+RcppExport SEXP _fpod_lazyLookup(SEXP xSEXP, SEXP tableSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type table(tableSEXP);
+    rcpp_result_gen = Rcpp::wrap(lazyLookup(x, table));
+    return rcpp_result_gen;
+END_RCPP
+}
+// lazyTime
+SEXP lazyTime(SEXP x, double origin);
+RcppExport SEXP _fpod_lazyTime(SEXP xSEXP, SEXP originSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type origin(originSEXP);
+    rcpp_result_gen = Rcpp::wrap(lazyTime(x, origin));
+    return rcpp_result_gen;
+END_RCPP
+}
+// overviewFPOD
+Rcpp::List overviewFPOD(const std::string file, int bin_minutes, Rcpp::NumericVector khz_table, Rcpp::NumericVector amp_table, Rcpp::NumericVector angle_table);
+RcppExport SEXP _fpod_overviewFPOD(SEXP fileSEXP, SEXP bin_minutesSEXP, SEXP khz_tableSEXP, SEXP amp_tableSEXP, SEXP angle_tableSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< int >::type bin_minutes(bin_minutesSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type khz_table(khz_tableSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type amp_table(amp_tableSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type angle_table(angle_tableSEXP);
+    rcpp_result_gen = Rcpp::wrap(overviewFPOD(file, bin_minutes, khz_table, amp_table, angle_table));
+    return rcpp_result_gen;
+END_RCPP
+}
 // readFPOD
-Rcpp::List readFPOD(const std::string file);
-RcppExport SEXP _fpod_readFPOD(SEXP fileSEXP) {
+Rcpp::List readFPOD(const std::string file, bool compact, double chunk_size, Rcpp::Nullable<Rcpp::Function> callback, bool lazy, bool profile, Rcpp::Nullable<Rcpp::Function> progress, bool validate, int sample);
+RcppExport SEXP _fpod_readFPOD(SEXP fileSEXP, SEXP compactSEXP, SEXP chunk_sizeSEXP, SEXP callbackSEXP, SEXP lazySEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP validateSEXP, SEXP sampleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type compact(compactSEXP);
+    Rcpp::traits::input_parameter< double >::type chunk_size(chunk_sizeSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::Function> >::type callback(callbackSEXP);
+    Rcpp::traits::input_parameter< bool >::type lazy(lazySEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::Function> >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< bool >::type validate(validateSEXP);
+    Rcpp::traits::input_parameter< int >::type sample(sampleSEXP);
+    rcpp_result_gen = Rcpp::wrap(readFPOD(file, compact, chunk_size, callback, lazy, profile, progress, validate, sample));
+    return rcpp_result_gen;
+END_RCPP
+}
+// validateFPOD
+Rcpp::DataFrame validateFPOD(const std::string file);
+RcppExport SEXP _fpod_validateFPOD(SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(validateFPOD(file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// prefetchFiles
+Rcpp::LogicalVector prefetchFiles(const std::vector<std::string> files);
+RcppExport SEXP _fpod_prefetchFiles(SEXP filesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::vector<std::string> >::type files(filesSEXP);
+    rcpp_result_gen = Rcpp::wrap(prefetchFiles(files));
+    return rcpp_result_gen;
+END_RCPP
+}
+// readFPODAsync
+SEXP readFPODAsync(const std::string file, bool compact);
+RcppExport SEXP _fpod_readFPODAsync(SEXP fileSEXP, SEXP compactSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type compact(compactSEXP);
+    rcpp_result_gen = Rcpp::wrap(readFPODAsync(file, compact));
+    return rcpp_result_gen;
+END_RCPP
+}
+// asyncReady
+bool asyncReady(SEXP handle);
+RcppExport SEXP _fpod_asyncReady(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(asyncReady(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// asyncValue
+Rcpp::List asyncValue(SEXP handle);
+RcppExport SEXP _fpod_asyncValue(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(asyncValue(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// asyncCancel
+void asyncCancel(SEXP handle);
+RcppExport SEXP _fpod_asyncCancel(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    asyncCancel(handle);
+    return R_NilValue;
+END_RCPP
+}
+// clickTimeNs
+SEXP clickTimeNs(SEXP minute, SEXP microsec, double origin);
+RcppExport SEXP _fpod_clickTimeNs(SEXP minuteSEXP, SEXP microsecSEXP, SEXP originSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type minute(minuteSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type microsec(microsecSEXP);
+    Rcpp::traits::input_parameter< double >::type origin(originSEXP);
+    rcpp_result_gen = Rcpp::wrap(clickTimeNs(minute, microsec, origin));
+    return rcpp_result_gen;
+END_RCPP
+}
+// clickIntervals
+SEXP clickIntervals(SEXP time);
+RcppExport SEXP _fpod_clickIntervals(SEXP timeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type time(timeSEXP);
+    rcpp_result_gen = Rcpp::wrap(clickIntervals(time));
+    return rcpp_result_gen;
+END_RCPP
+}
+// integer64ToDouble
+SEXP integer64ToDouble(SEXP x, double unit);
+RcppExport SEXP _fpod_integer64ToDouble(SEXP xSEXP, SEXP unitSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type unit(unitSEXP);
+    rcpp_result_gen = Rcpp::wrap(integer64ToDouble(x, unit));
+    return rcpp_result_gen;
+END_RCPP
+}
+// writeSynthetic
+double writeSynthetic(const std::string file, Rcpp::List header, double minutes, double click_rate, double train_density, double wav_density, double seed);
+RcppExport SEXP _fpod_writeSynthetic(SEXP fileSEXP, SEXP headerSEXP, SEXP minutesSEXP, SEXP click_rateSEXP, SEXP train_densitySEXP, SEXP wav_densitySEXP, SEXP seedSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
-    rcpp_result_gen = Rcpp::wrap(readFPOD(file));
+    Rcpp::traits::input_parameter< Rcpp::List >::type header(headerSEXP);
+    Rcpp::traits::input_parameter< double >::type minutes(minutesSEXP);
+    Rcpp::traits::input_parameter< double >::type click_rate(click_rateSEXP);
+    Rcpp::traits::input_parameter< double >::type train_density(train_densitySEXP);
+    Rcpp::traits::input_parameter< double >::type wav_density(wav_densitySEXP);
+    Rcpp::traits::input_parameter< double >::type seed(seedSEXP);
+    rcpp_result_gen = Rcpp::wrap(writeSynthetic(file, header, minutes, click_rate, train_density, wav_density, seed));
     return rcpp_result_gen;
 END_RCPP
 }
+// writeFPOD
+double writeFPOD(const std::string file, Rcpp::List header, Rcpp::List clicks, Rcpp::List env, Rcpp::IntegerVector wav_start, Rcpp::IntegerVector wav_length, Rcpp::IntegerVector wav_ipi, Rcpp::IntegerVector wav_spl);
+RcppExport SEXP _fpod_writeFPOD(SEXP fileSEXP, SEXP headerSEXP, SEXP clicksSEXP, SEXP envSEXP, SEXP wav_startSEXP, SEXP wav_lengthSEXP, SEXP wav_ipiSEXP, SEXP wav_splSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type header(headerSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type clicks(clicksSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type env(envSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type wav_start(wav_startSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type wav_length(wav_lengthSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type wav_ipi(wav_ipiSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type wav_spl(wav_splSEXP);
+    rcpp_result_gen = Rcpp::wrap(writeFPOD(file, header, clicks, env, wav_start, wav_length, wav_ipi, wav_spl));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+void initAltrep(DllInfo* dll);
+void initArrow(DllInfo* dll);
+void initCache(DllInfo* dll);
+void initCompress(DllInfo* dll);
+void initLazy(DllInfo* dll);
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_fpod_readFPOD", (DL_FUNC) &_fpod_readFPOD, 1},
+    {"_fpod_exportArrow", (DL_FUNC) &_fpod_exportArrow, 4},
+    {"_fpod_writeCache", (DL_FUNC) &_fpod_writeCache, 3},
+    {"_fpod_openCache", (DL_FUNC) &_fpod_openCache, 1},
+    {"_fpod_mappedString", (DL_FUNC) &_fpod_mappedString, 2},
+    {"_fpod_compressColumn", (DL_FUNC) &_fpod_compressColumn, 1},
+    {"_fpod_compressTime", (DL_FUNC) &_fpod_compressTime, 2},
+    {"_fpod_lazyLookup", (DL_FUNC) &_fpod_lazyLookup, 2},
+    {"_fpod_lazyTime", (DL_FUNC) &_fpod_lazyTime, 2},
+    {"_fpod_overviewFPOD", (DL_FUNC) &_fpod_overviewFPOD, 5},
+    {"_fpod_readFPOD", (DL_FUNC) &_fpod_readFPOD, 9},
+    {"_fpod_validateFPOD", (DL_FUNC) &_fpod_validateFPOD, 1},
+    {"_fpod_prefetchFiles", (DL_FUNC) &_fpod_prefetchFiles, 1},
+    {"_fpod_readFPODAsync", (DL_FUNC) &_fpod_readFPODAsync, 2},
+    {"_fpod_asyncReady", (DL_FUNC) &_fpod_asyncReady, 1},
+    {"_fpod_asyncValue", (DL_FUNC) &_fpod_asyncValue, 1},
+    {"_fpod_asyncCancel", (DL_FUNC) &_fpod_asyncCancel, 1},
+    {"_fpod_clickTimeNs", (DL_FUNC) &_fpod_clickTimeNs, 3},
+    {"_fpod_clickIntervals", (DL_FUNC) &_fpod_clickIntervals, 1},
+    {"_fpod_integer64ToDouble", (DL_FUNC) &_fpod_integer64ToDouble, 2},
+    {"_fpod_writeSynthetic", (DL_FUNC) &_fpod_writeSynthetic, 7},
+    {"_fpod_writeFPOD", (DL_FUNC) &_fpod_writeFPOD, 8},
     {NULL, NULL, 0}
 };
 
 RcppExport void R_init_fpod(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    initAltrep(dll);
+    initArrow(dll);
+    initCache(dll);
+    initCompress(dll);
+    initLazy(dll);
 }
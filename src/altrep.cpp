@@ -0,0 +1,338 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include "altrep.h"
+
+namespace {
+
+R_altrep_class_t packed_integer_class;
+R_altrep_class_t packed_logical_class;
+R_altrep_class_t packed_real_class;
+R_altrep_class_t packed_string_class;
+
+// getPacked: returns element i of packed storage with the given width
+template<int width>
+inline unsigned int getPacked(const Rbyte* p, R_xlen_t i) {
+    if (width == 1) {
+        return p[i];
+    }
+    uint16_t x;
+    std::memcpy(&x, p + 2 * i, sizeof(x));
+    return x;
+}
+
+// unpack: fills out with n elements of packed storage, starting at element i
+template<int width, class T>
+void unpack(const Rbyte* p, R_xlen_t i, R_xlen_t n, T* out) {
+    for (R_xlen_t j = 0; j < n; j++) {
+        out[j] = static_cast<T>(getPacked<width>(p, i + j));
+    }
+}
+
+template<class T>
+void unpack(const Rbyte* p, int width, R_xlen_t i, R_xlen_t n, T* out) {
+    if (width == 1) {
+        unpack<1>(p, i, n, out);
+    } else {
+        unpack<2>(p, i, n, out);
+    }
+}
+
+// The packed vector classes keep a list with the raw storage, the number of
+// bytes per element, and (for character vectors) the levels in data1. Once R
+// asks for a pointer to the data, the unpacked vector is kept in data2, and
+// takes precedence over the packed storage from then on, since R may modify it.
+
+SEXP newPacked(R_altrep_class_t cls, SEXP storage, int width, SEXP levels) {
+    SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(data1, 0, storage);
+    SET_VECTOR_ELT(data1, 1, Rf_ScalarInteger(width));
+    SET_VECTOR_ELT(data1, 2, levels);
+    SEXP ret = R_new_altrep(cls, data1, R_NilValue);
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP storageOf(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 0);
+}
+
+int widthOf(SEXP x) {
+    return INTEGER(VECTOR_ELT(R_altrep_data1(x), 1))[0];
+}
+
+SEXP levelsOf(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 2);
+}
+
+bool isMaterialized(SEXP x) {
+    return R_altrep_data2(x) != R_NilValue;
+}
+
+R_xlen_t packedLength(SEXP x) {
+    return Rf_xlength(storageOf(x)) / widthOf(x);
+}
+
+SEXP unpacked(SEXP x, SEXPTYPE type) {
+    switch (type) {
+    case INTSXP: return unpackInteger(storageOf(x), widthOf(x));
+    case LGLSXP: return unpackLogical(storageOf(x));
+    case REALSXP: return unpackReal(storageOf(x), widthOf(x));
+    default: return unpackString(storageOf(x), levelsOf(x));
+    }
+}
+
+template<SEXPTYPE type>
+SEXP materialize(SEXP x) {
+    if (!isMaterialized(x)) {
+        R_set_altrep_data2(x, unpacked(x, type));
+    }
+    return R_altrep_data2(x);
+}
+
+// methods shared by all packed vector classes
+
+Rboolean packedInspect(SEXP x, int pre, int deep, int pvec,
+                       void (*inspect_subtree)(SEXP, int, int, int)) {
+    Rprintf(" fpod packed vector (%d byte(s) per element%s)\n", widthOf(x),
+            isMaterialized(x) ? ", materialized" : "");
+    return TRUE;
+}
+
+SEXP packedSerializedState(SEXP x) {
+    // once materialized, the vector may have been modified, so serialize it
+    // as a regular vector
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    return R_altrep_data1(x);
+}
+
+template<R_altrep_class_t* cls>
+SEXP packedUnserialize(SEXP, SEXP state) {
+    return R_new_altrep(*cls, state, R_NilValue);
+}
+
+template<R_altrep_class_t* cls>
+SEXP packedDuplicate(SEXP x, Rboolean deep) {
+    // the packed storage is never modified, so duplicates can share it
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    return R_new_altrep(*cls, R_altrep_data1(x), R_NilValue);
+}
+
+const void* packedDataptrOrNull(SEXP x) {
+    if (!isMaterialized(x)) {
+        return NULL;
+    }
+    return DATAPTR_RO(R_altrep_data2(x));
+}
+
+int packedNoNA(SEXP x) {
+    return isMaterialized(x) ? 0 : 1;
+}
+
+// integer
+
+void* packedIntegerDataptr(SEXP x, Rboolean writeable) {
+    return INTEGER(materialize<INTSXP>(x));
+}
+
+int packedIntegerElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return INTEGER(R_altrep_data2(x))[i];
+    }
+    return static_cast<int>(widthOf(x) == 1 ?
+        getPacked<1>(RAW(storageOf(x)), i) : getPacked<2>(RAW(storageOf(x)), i));
+}
+
+R_xlen_t packedIntegerGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, int* buf) {
+    R_xlen_t len = packedLength(x);
+    n = std::min(n, len - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, INTEGER(R_altrep_data2(x)) + i, n * sizeof(int));
+    } else {
+        unpack(RAW(storageOf(x)), widthOf(x), i, n, buf);
+    }
+    return n;
+}
+
+// logical
+
+void* packedLogicalDataptr(SEXP x, Rboolean writeable) {
+    return LOGICAL(materialize<LGLSXP>(x));
+}
+
+int packedLogicalElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return LOGICAL(R_altrep_data2(x))[i];
+    }
+    return RAW(storageOf(x))[i] != 0;
+}
+
+R_xlen_t packedLogicalGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, int* buf) {
+    R_xlen_t len = packedLength(x);
+    n = std::min(n, len - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, LOGICAL(R_altrep_data2(x)) + i, n * sizeof(int));
+    } else {
+        const Rbyte* p = RAW(storageOf(x));
+        for (R_xlen_t j = 0; j < n; j++) {
+            buf[j] = p[i + j] != 0;
+        }
+    }
+    return n;
+}
+
+// real
+
+void* packedRealDataptr(SEXP x, Rboolean writeable) {
+    return REAL(materialize<REALSXP>(x));
+}
+
+double packedRealElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return REAL(R_altrep_data2(x))[i];
+    }
+    return static_cast<double>(widthOf(x) == 1 ?
+        getPacked<1>(RAW(storageOf(x)), i) : getPacked<2>(RAW(storageOf(x)), i));
+}
+
+R_xlen_t packedRealGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, double* buf) {
+    R_xlen_t len = packedLength(x);
+    n = std::min(n, len - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, REAL(R_altrep_data2(x)) + i, n * sizeof(double));
+    } else {
+        unpack(RAW(storageOf(x)), widthOf(x), i, n, buf);
+    }
+    return n;
+}
+
+// string
+
+void* packedStringDataptr(SEXP x, Rboolean writeable) {
+    return const_cast<SEXP*>(STRING_PTR_RO(materialize<STRSXP>(x)));
+}
+
+SEXP packedStringElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return STRING_ELT(R_altrep_data2(x), i);
+    }
+    return STRING_ELT(levelsOf(x), RAW(storageOf(x))[i]);
+}
+
+void packedStringSetElt(SEXP x, R_xlen_t i, SEXP value) {
+    SET_STRING_ELT(materialize<STRSXP>(x), i, value);
+}
+
+} // namespace
+
+SEXP packedInteger(SEXP storage, int width) {
+    return newPacked(packed_integer_class, storage, width, R_NilValue);
+}
+
+SEXP packedLogical(SEXP storage) {
+    return newPacked(packed_logical_class, storage, 1, R_NilValue);
+}
+
+SEXP packedReal(SEXP storage, int width) {
+    return newPacked(packed_real_class, storage, width, R_NilValue);
+}
+
+SEXP packedString(SEXP storage, SEXP levels) {
+    return newPacked(packed_string_class, storage, 1, levels);
+}
+
+SEXP unpackInteger(SEXP storage, int width) {
+    R_xlen_t n = Rf_xlength(storage) / width;
+    SEXP ret = PROTECT(Rf_allocVector(INTSXP, n));
+    unpack(RAW(storage), width, 0, n, INTEGER(ret));
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP unpackLogical(SEXP storage) {
+    R_xlen_t n = Rf_xlength(storage);
+    SEXP ret = PROTECT(Rf_allocVector(LGLSXP, n));
+    const Rbyte* p = RAW(storage);
+    int* out = LOGICAL(ret);
+    for (R_xlen_t i = 0; i < n; i++) {
+        out[i] = p[i] != 0;
+    }
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP unpackReal(SEXP storage, int width) {
+    R_xlen_t n = Rf_xlength(storage) / width;
+    SEXP ret = PROTECT(Rf_allocVector(REALSXP, n));
+    unpack(RAW(storage), width, 0, n, REAL(ret));
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP unpackString(SEXP storage, SEXP levels) {
+    R_xlen_t n = Rf_xlength(storage);
+    SEXP ret = PROTECT(Rf_allocVector(STRSXP, n));
+    const Rbyte* p = RAW(storage);
+    for (R_xlen_t i = 0; i < n; i++) {
+        SET_STRING_ELT(ret, i, STRING_ELT(levels, p[i]));
+    }
+    UNPROTECT(1);
+    return ret;
+}
+
+// [[Rcpp::init]]
+void initAltrep(DllInfo* dll) {
+
+    packed_integer_class = R_make_altinteger_class("packed_integer", "fpod", dll);
+    packed_logical_class = R_make_altlogical_class("packed_logical", "fpod", dll);
+    packed_real_class = R_make_altreal_class("packed_real", "fpod", dll);
+    packed_string_class = R_make_altstring_class("packed_string", "fpod", dll);
+
+    R_altrep_class_t* classes[] = {&packed_integer_class, &packed_logical_class,
+                                   &packed_real_class, &packed_string_class};
+    for (R_altrep_class_t* cls : classes) {
+        R_set_altrep_Length_method(*cls, packedLength);
+        R_set_altrep_Inspect_method(*cls, packedInspect);
+        R_set_altrep_Serialized_state_method(*cls, packedSerializedState);
+        R_set_altvec_Dataptr_or_null_method(*cls, packedDataptrOrNull);
+    }
+
+    R_set_altrep_Unserialize_method(packed_integer_class, packedUnserialize<&packed_integer_class>);
+    R_set_altrep_Unserialize_method(packed_logical_class, packedUnserialize<&packed_logical_class>);
+    R_set_altrep_Unserialize_method(packed_real_class, packedUnserialize<&packed_real_class>);
+    R_set_altrep_Unserialize_method(packed_string_class, packedUnserialize<&packed_string_class>);
+
+    R_set_altrep_Duplicate_method(packed_integer_class, packedDuplicate<&packed_integer_class>);
+    R_set_altrep_Duplicate_method(packed_logical_class, packedDuplicate<&packed_logical_class>);
+    R_set_altrep_Duplicate_method(packed_real_class, packedDuplicate<&packed_real_class>);
+    R_set_altrep_Duplicate_method(packed_string_class, packedDuplicate<&packed_string_class>);
+
+    R_set_altvec_Dataptr_method(packed_integer_class, packedIntegerDataptr);
+    R_set_altinteger_Elt_method(packed_integer_class, packedIntegerElt);
+    R_set_altinteger_Get_region_method(packed_integer_class, packedIntegerGetRegion);
+    R_set_altinteger_No_NA_method(packed_integer_class, packedNoNA);
+
+    R_set_altvec_Dataptr_method(packed_logical_class, packedLogicalDataptr);
+    R_set_altlogical_Elt_method(packed_logical_class, packedLogicalElt);
+    R_set_altlogical_Get_region_method(packed_logical_class, packedLogicalGetRegion);
+    R_set_altlogical_No_NA_method(packed_logical_class, packedNoNA);
+
+    R_set_altvec_Dataptr_method(packed_real_class, packedRealDataptr);
+    R_set_altreal_Elt_method(packed_real_class, packedRealElt);
+    R_set_altreal_Get_region_method(packed_real_class, packedRealGetRegion);
+    R_set_altreal_No_NA_method(packed_real_class, packedNoNA);
+
+    R_set_altvec_Dataptr_method(packed_string_class, packedStringDataptr);
+    R_set_altstring_Elt_method(packed_string_class, packedStringElt);
+    R_set_altstring_Set_elt_method(packed_string_class, packedStringSetElt);
+    R_set_altstring_No_NA_method(packed_string_class, packedNoNA);
+}
@@ -0,0 +1,46 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_ALTREP_H
+#define FPOD_ALTREP_H
+
+#include <Rcpp.h>
+#include <cstring> // for std::memcpy
+
+// R < 3.6 uses `class` as a parameter name in Altrep.h, which is a reserved
+// word in C++
+#if R_VERSION < R_Version(3, 6, 0)
+#define class klass
+extern "C" {
+#include <R_ext/Altrep.h>
+}
+#undef class
+#else
+#include <R_ext/Altrep.h>
+#endif
+
+// packed vectors are ordinary R vectors (integer, logical, double or character)
+// whose elements are stored in one or two bytes each of a raw vector
+
+SEXP packedInteger(SEXP storage, int width);
+SEXP packedLogical(SEXP storage);
+SEXP packedReal(SEXP storage, int width);
+SEXP packedString(SEXP storage, SEXP levels);
+
+// unpack*: same as above, but returns a regular (materialized) R vector
+SEXP unpackInteger(SEXP storage, int width);
+SEXP unpackLogical(SEXP storage);
+SEXP unpackReal(SEXP storage, int width);
+SEXP unpackString(SEXP storage, SEXP levels);
+
+// setU16: stores x as element i of a raw vector with two bytes per element
+inline void setU16(Rcpp::RawVector& storage, R_xlen_t i, uint16_t x) {
+    std::memcpy(&storage[2 * i], &x, sizeof(x));
+}
+
+#endif
@@ -0,0 +1,447 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include <Rcpp.h> // for interfacing with R
+#include <cmath> // for std::llround
+#include <cstdlib> // for std::strtoull
+#include <memory> // for std::shared_ptr
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The Arrow C data interface, as specified at
+// https://arrow.apache.org/docs/format/CDataInterface.html
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace {
+
+// Exported arrays point into the R vectors they were made from, which are
+// kept from garbage collection until the consumer releases the arrays. The
+// consumer may do that from another thread, but R may only be used from the
+// main thread, so those releases are queued, and done on the next export.
+
+std::thread::id main_thread;
+std::mutex release_mutex;
+std::vector<SEXP> release_queue;
+
+void releaseQueued() {
+    std::vector<SEXP> queued;
+    {
+        std::lock_guard<std::mutex> lock(release_mutex);
+        queued.swap(release_queue);
+    }
+    for (SEXP x : queued) {
+        R_ReleaseObject(x);
+    }
+}
+
+// Preserved: keeps an R object from garbage collection while it exists
+class Preserved {
+public:
+    explicit Preserved(SEXP m_x) : x(m_x) {
+        R_PreserveObject(x);
+    }
+    ~Preserved() {
+        if (std::this_thread::get_id() == main_thread) {
+            R_ReleaseObject(x);
+        } else {
+            std::lock_guard<std::mutex> lock(release_mutex);
+            release_queue.push_back(x);
+        }
+    }
+    Preserved(const Preserved&) = delete;
+    Preserved& operator=(const Preserved&) = delete;
+private:
+    SEXP x;
+};
+
+// SchemaData: the private data of an exported schema
+struct SchemaData {
+    std::string format;
+    std::string name;
+    std::vector<ArrowSchema*> children;
+};
+
+// ArrayData: the private data of an exported array, with the buffers that
+// are not R vectors
+struct ArrayData {
+    std::shared_ptr<Preserved> keep;
+    std::vector<const void*> buffers;
+    std::vector<ArrowArray*> children;
+    std::vector<uint8_t> validity;
+    std::vector<uint8_t> bits;
+    std::vector<int32_t> int32s;
+    std::vector<int64_t> int64s;
+    std::string chars;
+};
+
+void releaseSchema(ArrowSchema* schema) {
+    SchemaData* data = static_cast<SchemaData*>(schema->private_data);
+    for (ArrowSchema* child : data->children) {
+        // consumers may have moved the child, and released it themselves
+        if (child->release != nullptr) {
+            child->release(child);
+        }
+        delete child;
+    }
+    if (schema->dictionary != nullptr) {
+        if (schema->dictionary->release != nullptr) {
+            schema->dictionary->release(schema->dictionary);
+        }
+        delete schema->dictionary;
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+void releaseArray(ArrowArray* array) {
+    ArrayData* data = static_cast<ArrayData*>(array->private_data);
+    for (ArrowArray* child : data->children) {
+        if (child->release != nullptr) {
+            child->release(child);
+        }
+        delete child;
+    }
+    if (array->dictionary != nullptr) {
+        if (array->dictionary->release != nullptr) {
+            array->dictionary->release(array->dictionary);
+        }
+        delete array->dictionary;
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+void initSchema(ArrowSchema* schema, const std::string& format, const std::string& name,
+                int64_t flags) {
+    SchemaData* data = new SchemaData{format, name, {}};
+    schema->format = data->format.c_str();
+    schema->name = data->name.c_str();
+    schema->metadata = nullptr;
+    schema->flags = flags;
+    schema->n_children = 0;
+    schema->children = nullptr;
+    schema->dictionary = nullptr;
+    schema->release = releaseSchema;
+    schema->private_data = data;
+}
+
+ArrayData* initArray(ArrowArray* array, int64_t length, std::shared_ptr<Preserved> keep) {
+    ArrayData* data = new ArrayData;
+    data->keep = keep;
+    array->length = length;
+    array->null_count = 0;
+    array->offset = 0;
+    array->n_buffers = 0;
+    array->n_children = 0;
+    array->buffers = nullptr;
+    array->children = nullptr;
+    array->dictionary = nullptr;
+    array->release = releaseArray;
+    array->private_data = data;
+    return data;
+}
+
+void setBuffers(ArrowArray* array, ArrayData* data, std::vector<const void*> buffers) {
+    data->buffers = buffers;
+    array->n_buffers = static_cast<int64_t>(data->buffers.size());
+    array->buffers = data->buffers.data();
+}
+
+// setValidity: makes the validity bitmap of an array from whether each
+// element is NA, and returns it (or nullptr if there are no NAs)
+template<class IsNA>
+const void* setValidity(ArrowArray* array, ArrayData* data, R_xlen_t n, IsNA is_na) {
+    int64_t nulls = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+        if (is_na(i)) {
+            if (nulls == 0) {
+                data->validity.assign((n + 7) / 8, 0xFF);
+            }
+            data->validity[i / 8] &= static_cast<uint8_t>(~(1 << (i % 8)));
+            nulls++;
+        }
+    }
+    array->null_count = nulls;
+    return nulls > 0 ? data->validity.data() : nullptr;
+}
+
+// exportStrings: exports a character vector (the levels of a dictionary) as
+// an array of UTF-8 strings
+void exportStrings(SEXP x, ArrowSchema* schema, ArrowArray* array,
+                   std::shared_ptr<Preserved> keep) {
+    R_xlen_t n = Rf_xlength(x);
+    initSchema(schema, "u", "", ARROW_FLAG_NULLABLE);
+    ArrayData* data = initArray(array, n, keep);
+    const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+        return STRING_ELT(x, i) == NA_STRING;
+    });
+    data->int32s.resize(n + 1);
+    data->int32s[0] = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+        SEXP s = STRING_ELT(x, i);
+        if (s != NA_STRING) {
+            data->chars += Rf_translateCharUTF8(s);
+        }
+        if (data->chars.size() > INT32_MAX) {
+            Rcpp::stop("Too many characters to export");
+        }
+        data->int32s[i + 1] = static_cast<int32_t>(data->chars.size());
+    }
+    setBuffers(array, data, {validity, data->int32s.data(), data->chars.data()});
+}
+
+// exportColumn: exports a column of a data.frame
+void exportColumn(SEXP x, const std::string& name, ArrowSchema* schema, ArrowArray* array,
+                  std::shared_ptr<Preserved> keep) {
+    R_xlen_t n = Rf_xlength(x);
+
+    if (TYPEOF(x) == STRSXP || Rf_isFactor(x)) {
+        // dictionary encoded: 0-based int32 indices into the levels
+        SEXP levels;
+        initSchema(schema, "i", name, ARROW_FLAG_NULLABLE);
+        ArrayData* data = initArray(array, n, keep);
+        data->int32s.resize(n);
+        if (Rf_isFactor(x)) {
+            levels = Rf_getAttrib(x, R_LevelsSymbol);
+            const int* codes = INTEGER_RO(x);
+            for (R_xlen_t i = 0; i < n; i++) {
+                data->int32s[i] = codes[i] == NA_INTEGER ? 0 : codes[i] - 1;
+            }
+        } else {
+            // the levels are in order of first appearance; strings in R are
+            // cached, so equal strings have the same pointer
+            std::unordered_map<SEXP, int32_t> index;
+            std::vector<SEXP> seen;
+            for (R_xlen_t i = 0; i < n; i++) {
+                SEXP s = STRING_ELT(x, i);
+                if (s == NA_STRING) {
+                    data->int32s[i] = 0;
+                    continue;
+                }
+                auto it = index.emplace(s, static_cast<int32_t>(seen.size())).first;
+                if (it->second == static_cast<int32_t>(seen.size())) {
+                    seen.push_back(s);
+                }
+                data->int32s[i] = it->second;
+            }
+            levels = PROTECT(Rf_allocVector(STRSXP, seen.size()));
+            for (std::size_t k = 0; k < seen.size(); k++) {
+                SET_STRING_ELT(levels, k, seen[k]);
+            }
+        }
+        const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+            return TYPEOF(x) == STRSXP ? STRING_ELT(x, i) == NA_STRING :
+                INTEGER_ELT(x, i) == NA_INTEGER;
+        });
+        setBuffers(array, data, {validity, data->int32s.data()});
+
+        schema->dictionary = new ArrowSchema;
+        array->dictionary = new ArrowArray;
+        exportStrings(levels, schema->dictionary, array->dictionary, keep);
+        if (TYPEOF(x) == STRSXP) {
+            UNPROTECT(1);
+        }
+        return;
+    }
+
+    if (TYPEOF(x) == INTSXP) {
+        initSchema(schema, "i", name, ARROW_FLAG_NULLABLE);
+        ArrayData* data = initArray(array, n, keep);
+        const int* values = INTEGER_RO(x);
+        const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+            return values[i] == NA_INTEGER;
+        });
+        setBuffers(array, data, {validity, values});
+        return;
+    }
+
+    if (TYPEOF(x) == LGLSXP) {
+        // booleans are one bit each in Arrow, so these are copied
+        initSchema(schema, "b", name, ARROW_FLAG_NULLABLE);
+        ArrayData* data = initArray(array, n, keep);
+        const int* values = LOGICAL_RO(x);
+        const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+            return values[i] == NA_LOGICAL;
+        });
+        data->bits.assign((n + 7) / 8, 0);
+        for (R_xlen_t i = 0; i < n; i++) {
+            if (values[i] != NA_LOGICAL && values[i] != 0) {
+                data->bits[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+        }
+        setBuffers(array, data, {validity, data->bits.data()});
+        return;
+    }
+
+    if (TYPEOF(x) != REALSXP) {
+        Rcpp::stop("Unable to export column %s of type %s", name, Rf_type2char(TYPEOF(x)));
+    }
+
+    const double* values = REAL_RO(x);
+    if (Rf_inherits(x, "integer64")) {
+        // 64-bit integers, stored in the bits of doubles. Times from
+        // fp_read(time = "integer64") are nanoseconds since 1970 (UTC).
+        const int64_t* longs = reinterpret_cast<const int64_t*>(values);
+        bool is_time = name == "time" || Rf_inherits(x, "nanotime");
+        initSchema(schema, is_time ? "tsn:UTC" : "l", name, ARROW_FLAG_NULLABLE);
+        ArrayData* data = initArray(array, n, keep);
+        const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+            return longs[i] == INT64_MIN;
+        });
+        setBuffers(array, data, {validity, longs});
+        return;
+    }
+
+    if (Rf_inherits(x, "POSIXct")) {
+        // seconds since 1970 as doubles, which are copied to microseconds as
+        // 64-bit integers; times without a time zone are exported as UTC
+        SEXP tzone = Rf_getAttrib(x, Rf_install("tzone"));
+        std::string tz = "UTC";
+        if (TYPEOF(tzone) == STRSXP && Rf_xlength(tzone) > 0 &&
+            STRING_ELT(tzone, 0) != NA_STRING && CHAR(STRING_ELT(tzone, 0))[0] != '\0') {
+            tz = CHAR(STRING_ELT(tzone, 0));
+        }
+        initSchema(schema, "tsu:" + tz, name, ARROW_FLAG_NULLABLE);
+        ArrayData* data = initArray(array, n, keep);
+        const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+            return !std::isfinite(values[i]);
+        });
+        data->int64s.resize(n);
+        for (R_xlen_t i = 0; i < n; i++) {
+            data->int64s[i] = std::isfinite(values[i]) ? std::llround(values[i] * 1e6) : 0;
+        }
+        setBuffers(array, data, {validity, data->int64s.data()});
+        return;
+    }
+
+    initSchema(schema, "g", name, ARROW_FLAG_NULLABLE);
+    ArrayData* data = initArray(array, n, keep);
+    const void* validity = setValidity(array, data, n, [&](R_xlen_t i) {
+        return R_IsNA(values[i]) != 0;
+    });
+    setBuffers(array, data, {validity, values});
+}
+
+// pointerOf: returns the address in an external pointer, or in a double or
+// character string, as used by e.g. the arrow and nanoarrow packages
+void* pointerOf(SEXP ptr, const char* name) {
+    switch (TYPEOF(ptr)) {
+    case EXTPTRSXP:
+        return R_ExternalPtrAddr(ptr);
+    case REALSXP:
+        if (Rf_xlength(ptr) == 1) {
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(REAL(ptr)[0]));
+        }
+        break;
+    case STRSXP:
+        if (Rf_xlength(ptr) == 1) {
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(
+                std::strtoull(CHAR(STRING_ELT(ptr, 0)), nullptr, 10)));
+        }
+        break;
+    }
+    Rcpp::stop("%s must be an external pointer or an address", name);
+}
+
+} // namespace
+
+// exportArrow: exports a data.frame (with n rows) as an Arrow struct array,
+// through the Arrow C data interface, to the ArrowArray and ArrowSchema at
+// the given addresses. The numeric columns are not copied.
+// [[Rcpp::export]]
+void exportArrow(Rcpp::List x, double n, SEXP array_ptr, SEXP schema_ptr) {
+    ArrowArray* array = static_cast<ArrowArray*>(pointerOf(array_ptr, "array"));
+    ArrowSchema* schema = static_cast<ArrowSchema*>(pointerOf(schema_ptr, "schema"));
+    if (array == nullptr || schema == nullptr) {
+        Rcpp::stop("array and schema must not be NULL pointers");
+    }
+    releaseQueued();
+
+    Rcpp::CharacterVector names = x.names();
+    R_xlen_t n_cols = x.size();
+    // the buffers point into the column vectors, which data.table may replace
+    // or drop from x by reference, so a list of the columns themselves is kept
+    SEXP columns = PROTECT(Rf_allocVector(VECSXP, n_cols));
+    for (R_xlen_t j = 0; j < n_cols; j++) {
+        SET_VECTOR_ELT(columns, j, x[j]);
+    }
+    std::shared_ptr<Preserved> keep = std::make_shared<Preserved>(columns);
+    UNPROTECT(1);
+
+    // the schema and array are filled in a local copy, and only handed over
+    // when complete, so that an error leaves the consumer's structs unchanged
+    ArrowSchema out_schema;
+    ArrowArray out_array;
+    initSchema(&out_schema, "+s", "", 0);
+    ArrayData* data = initArray(&out_array, static_cast<int64_t>(n), keep);
+    setBuffers(&out_array, data, {nullptr});
+    SchemaData* schema_data = static_cast<SchemaData*>(out_schema.private_data);
+
+    try {
+        for (R_xlen_t j = 0; j < n_cols; j++) {
+            schema_data->children.push_back(new ArrowSchema);
+            schema_data->children.back()->release = nullptr;
+            data->children.push_back(new ArrowArray);
+            data->children.back()->release = nullptr;
+            exportColumn(VECTOR_ELT(columns, j), Rcpp::as<std::string>(names[j]),
+                         schema_data->children.back(), data->children.back(), keep);
+        }
+    } catch (...) {
+        releaseSchema(&out_schema);
+        releaseArray(&out_array);
+        throw;
+    }
+
+    out_schema.n_children = n_cols;
+    out_schema.children = schema_data->children.data();
+    out_array.n_children = n_cols;
+    out_array.children = data->children.data();
+    *schema = out_schema;
+    *array = out_array;
+}
+
+// [[Rcpp::init]]
+void initArrow(DllInfo* dll) {
+    main_thread = std::this_thread::get_id();
+}
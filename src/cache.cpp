@@ -0,0 +1,446 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include "altrep.h" // for R_ext/Altrep.h
+#include <fpod/mapped_file.h> // for MappedFile
+#include <algorithm> // for std::min
+#include <cstdio> // for std::remove
+#include <filesystem> // for rename()
+#include <fstream>
+#include <memory> // for std::shared_ptr
+#include <vector>
+
+// A cache file holds decoded columns (integer, logical or double vectors) as
+// they are laid out in memory, so that they can be mapped and used by R
+// without copying them. The layout is, in native byte order:
+//
+//   magic      8 bytes, "FPODCACH"
+//   version    uint32, 1 (which also tells the byte order)
+//   n_columns  uint32
+//   meta_size  uint64
+//   directory  n_columns x {uint32 type (SEXPTYPE), uint32 0, uint64 length,
+//              uint64 offset}
+//   meta       meta_size bytes, which the R side uses for everything else
+//   data       the columns, each starting at an offset that is a multiple of
+//              cache_alignment bytes
+
+namespace {
+
+const char cache_magic[8] = {'F', 'P', 'O', 'D', 'C', 'A', 'C', 'H'};
+const uint32_t cache_version = 1;
+const uint64_t cache_alignment = 64;
+
+struct CacheColumn {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t offset;
+};
+
+uint64_t alignUp(uint64_t x) {
+    return (x + cache_alignment - 1) / cache_alignment * cache_alignment;
+}
+
+uint64_t elementSize(uint32_t type) {
+    return type == REALSXP ? sizeof(double) : sizeof(int);
+}
+
+R_altrep_class_t mapped_integer_class;
+R_altrep_class_t mapped_logical_class;
+R_altrep_class_t mapped_real_class;
+R_altrep_class_t mapped_string_class;
+
+// The mapped vector classes keep a list with the external pointer to the
+// MappedFile, the offset of the column in the file and its length in data1.
+// Their data is read straight from the mapping, which is shared by every R
+// process that maps the file. Once R asks for a writeable pointer to the data,
+// a copy is kept in data2, and takes precedence from then on, since R may
+// modify it.
+//
+// Mapped character vectors keep a mapped integer vector with the (1-based)
+// codes and the levels in data1 instead.
+
+typedef std::shared_ptr<fpod::MappedFile> MappedPtr;
+
+void finalizeMapping(SEXP source) {
+    delete static_cast<MappedPtr*>(R_ExternalPtrAddr(source));
+    R_ClearExternalPtr(source);
+}
+
+SEXP newMapped(R_altrep_class_t cls, SEXP source, uint64_t offset, uint64_t length) {
+    SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(data1, 0, source);
+    SET_VECTOR_ELT(data1, 1, Rf_ScalarReal(static_cast<double>(offset)));
+    SET_VECTOR_ELT(data1, 2, Rf_ScalarReal(static_cast<double>(length)));
+    SEXP ret = R_new_altrep(cls, data1, R_NilValue);
+    UNPROTECT(1);
+    return ret;
+}
+
+bool isMaterialized(SEXP x) {
+    return R_altrep_data2(x) != R_NilValue;
+}
+
+R_xlen_t mappedLength(SEXP x) {
+    return static_cast<R_xlen_t>(REAL(VECTOR_ELT(R_altrep_data1(x), 2))[0]);
+}
+
+// mappedData: returns a pointer to the column in the mapping
+const void* mappedData(SEXP x) {
+    SEXP data1 = R_altrep_data1(x);
+    const MappedPtr* file = static_cast<MappedPtr*>(R_ExternalPtrAddr(VECTOR_ELT(data1, 0)));
+    uint64_t offset = static_cast<uint64_t>(REAL(VECTOR_ELT(data1, 1))[0]);
+    return (*file)->data() + offset;
+}
+
+template<SEXPTYPE type>
+SEXP materialize(SEXP x) {
+    if (!isMaterialized(x)) {
+        R_xlen_t n = mappedLength(x);
+        SEXP data = PROTECT(Rf_allocVector(type, n));
+        std::memcpy(DATAPTR(data), mappedData(x), n * elementSize(type));
+        R_set_altrep_data2(x, data);
+        UNPROTECT(1);
+    }
+    return R_altrep_data2(x);
+}
+
+// current: returns a pointer to the data of x, the copy if there is one
+template<class T>
+const T* current(SEXP x) {
+    if (isMaterialized(x)) {
+        return static_cast<const T*>(DATAPTR_RO(R_altrep_data2(x)));
+    }
+    return static_cast<const T*>(mappedData(x));
+}
+
+// methods shared by the mapped integer, logical and real classes
+
+Rboolean mappedInspect(SEXP x, int pre, int deep, int pvec,
+                       void (*inspect_subtree)(SEXP, int, int, int)) {
+    Rprintf(" fpod mapped vector (%s)\n",
+            isMaterialized(x) ? "materialized" : "shared");
+    return TRUE;
+}
+
+template<R_altrep_class_t* cls>
+SEXP mappedDuplicate(SEXP x, Rboolean deep) {
+    // the mapping is never modified, so duplicates can share it
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    SEXP data1 = R_altrep_data1(x);
+    return R_new_altrep(*cls, data1, R_NilValue);
+}
+
+template<SEXPTYPE type>
+void* mappedDataptr(SEXP x, Rboolean writeable) {
+    if (!writeable && !isMaterialized(x)) {
+        return const_cast<void*>(mappedData(x));
+    }
+    return DATAPTR(materialize<type>(x));
+}
+
+const void* mappedDataptrOrNull(SEXP x) {
+    if (isMaterialized(x)) {
+        return DATAPTR_RO(R_altrep_data2(x));
+    }
+    return mappedData(x);
+}
+
+template<class T>
+R_xlen_t mappedGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, T* buf) {
+    n = std::min(n, mappedLength(x) - i);
+    std::memcpy(buf, current<T>(x) + i, n * sizeof(T));
+    return n;
+}
+
+int mappedIntegerElt(SEXP x, R_xlen_t i) {
+    return current<int>(x)[i];
+}
+
+double mappedRealElt(SEXP x, R_xlen_t i) {
+    return current<double>(x)[i];
+}
+
+// string
+
+SEXP codesOf(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 0);
+}
+
+SEXP levelsOf(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 1);
+}
+
+R_xlen_t mappedStringLength(SEXP x) {
+    return Rf_xlength(codesOf(x));
+}
+
+SEXP level(SEXP levels, int code) {
+    if (code == NA_INTEGER || code < 1 || code > Rf_xlength(levels)) {
+        return NA_STRING;
+    }
+    return STRING_ELT(levels, code - 1);
+}
+
+SEXP materializeString(SEXP x) {
+    if (!isMaterialized(x)) {
+        R_xlen_t n = mappedStringLength(x);
+        SEXP data = PROTECT(Rf_allocVector(STRSXP, n));
+        const int* codes = INTEGER_RO(codesOf(x));
+        SEXP levels = levelsOf(x);
+        for (R_xlen_t i = 0; i < n; i++) {
+            SET_STRING_ELT(data, i, level(levels, codes[i]));
+        }
+        R_set_altrep_data2(x, data);
+        UNPROTECT(1);
+    }
+    return R_altrep_data2(x);
+}
+
+Rboolean mappedStringInspect(SEXP x, int pre, int deep, int pvec,
+                             void (*inspect_subtree)(SEXP, int, int, int)) {
+    Rprintf(" fpod mapped character vector (%d levels%s)\n",
+            static_cast<int>(Rf_xlength(levelsOf(x))),
+            isMaterialized(x) ? ", materialized" : "");
+    return TRUE;
+}
+
+SEXP mappedStringDuplicate(SEXP x, Rboolean deep) {
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    return R_new_altrep(mapped_string_class, R_altrep_data1(x), R_NilValue);
+}
+
+void* mappedStringDataptr(SEXP x, Rboolean writeable) {
+    return const_cast<SEXP*>(STRING_PTR_RO(materializeString(x)));
+}
+
+const void* mappedStringDataptrOrNull(SEXP x) {
+    if (!isMaterialized(x)) {
+        return NULL;
+    }
+    return DATAPTR_RO(R_altrep_data2(x));
+}
+
+SEXP mappedStringElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return STRING_ELT(R_altrep_data2(x), i);
+    }
+    return level(levelsOf(x), INTEGER_ELT(codesOf(x), i));
+}
+
+void mappedStringSetElt(SEXP x, R_xlen_t i, SEXP value) {
+    SET_STRING_ELT(materializeString(x), i, value);
+}
+
+// writeColumn: writes the elements of x, a chunk at a time, so that packed
+// and lazy vectors are not materialized
+void writeColumn(std::ofstream& out, SEXP x) {
+    const R_xlen_t chunk = 65536;
+    R_xlen_t n = Rf_xlength(x);
+    if (TYPEOF(x) == REALSXP) {
+        std::vector<double> buf(static_cast<std::size_t>(std::min(n, chunk)));
+        for (R_xlen_t i = 0; i < n; i += chunk) {
+            R_xlen_t m = REAL_GET_REGION(x, i, chunk, buf.data());
+            out.write(reinterpret_cast<const char*>(buf.data()), m * sizeof(double));
+        }
+    } else {
+        std::vector<int> buf(static_cast<std::size_t>(std::min(n, chunk)));
+        for (R_xlen_t i = 0; i < n; i += chunk) {
+            R_xlen_t m = TYPEOF(x) == LGLSXP ? LOGICAL_GET_REGION(x, i, chunk, buf.data()) :
+                INTEGER_GET_REGION(x, i, chunk, buf.data());
+            out.write(reinterpret_cast<const char*>(buf.data()), m * sizeof(int));
+        }
+    }
+}
+
+void writePadding(std::ofstream& out, uint64_t from, uint64_t to) {
+    static const char zeros[cache_alignment] = {};
+    out.write(zeros, static_cast<std::streamsize>(to - from));
+}
+
+} // namespace
+
+// writeCache: writes the columns (a list of integer, logical or double
+// vectors) and meta (a raw vector) to a cache file. The file is written under
+// a temporary name and renamed when complete, so that other processes never
+// map a partly written file.
+// [[Rcpp::export]]
+void writeCache(const std::string path, Rcpp::RawVector meta, Rcpp::List columns) {
+    using namespace Rcpp;
+
+    uint32_t n_columns = static_cast<uint32_t>(columns.size());
+    std::vector<CacheColumn> directory(n_columns);
+    uint64_t offset = alignUp(8 + 4 + 4 + 8 + n_columns * sizeof(CacheColumn) + meta.size());
+    for (uint32_t k = 0; k < n_columns; k++) {
+        SEXP x = VECTOR_ELT(columns, k);
+        if (TYPEOF(x) != INTSXP && TYPEOF(x) != LGLSXP && TYPEOF(x) != REALSXP) {
+            stop("Unable to cache vectors of type %s", Rf_type2char(TYPEOF(x)));
+        }
+        directory[k] = {static_cast<uint32_t>(TYPEOF(x)), 0,
+                        static_cast<uint64_t>(Rf_xlength(x)), offset};
+        offset = alignUp(offset + directory[k].length * elementSize(directory[k].type));
+    }
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        stop("Unable to open file %s for writing", tmp);
+    }
+
+    uint64_t meta_size = meta.size();
+    out.write(cache_magic, sizeof(cache_magic));
+    out.write(reinterpret_cast<const char*>(&cache_version), sizeof(cache_version));
+    out.write(reinterpret_cast<const char*>(&n_columns), sizeof(n_columns));
+    out.write(reinterpret_cast<const char*>(&meta_size), sizeof(meta_size));
+    out.write(reinterpret_cast<const char*>(directory.data()),
+              n_columns * sizeof(CacheColumn));
+    out.write(reinterpret_cast<const char*>(RAW(meta)), meta_size);
+
+    uint64_t pos = 8 + 4 + 4 + 8 + n_columns * sizeof(CacheColumn) + meta_size;
+    for (uint32_t k = 0; k < n_columns; k++) {
+        writePadding(out, pos, directory[k].offset);
+        writeColumn(out, VECTOR_ELT(columns, k));
+        pos = directory[k].offset + directory[k].length * elementSize(directory[k].type);
+    }
+    writePadding(out, pos, alignUp(pos));
+    out.close();
+
+    if (!out) {
+        std::remove(tmp.c_str());
+        stop("Unable to write to file %s", tmp);
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::remove(tmp.c_str());
+        stop("Unable to replace file %s: %s", path, ec.message());
+    }
+}
+
+// openCache: maps a cache file, and returns a list with the meta data (a raw
+// vector) and the columns, as mapped vectors
+// [[Rcpp::export]]
+Rcpp::List openCache(const std::string path) {
+    using namespace Rcpp;
+
+    MappedPtr file = std::make_shared<fpod::MappedFile>(path);
+    if (!file->is_open()) {
+        stop("Unable to open file %s", path);
+    }
+
+    const uint8_t* p = file->data();
+    uint64_t size = file->size();
+    const uint64_t fixed = 8 + 4 + 4 + 8;
+    if (size < fixed || std::memcmp(p, cache_magic, sizeof(cache_magic)) != 0) {
+        stop("%s is not an fpod cache file", path);
+    }
+    uint32_t version, n_columns;
+    uint64_t meta_size;
+    std::memcpy(&version, p + 8, sizeof(version));
+    std::memcpy(&n_columns, p + 12, sizeof(n_columns));
+    std::memcpy(&meta_size, p + 16, sizeof(meta_size));
+    if (version != cache_version) {
+        stop("%s was written by another version of fpod, or on a machine with another byte order",
+             path);
+    }
+
+    uint64_t meta_start = fixed + static_cast<uint64_t>(n_columns) * sizeof(CacheColumn);
+    if (meta_start > size || meta_size > size - meta_start) {
+        stop("%s is truncated", path);
+    }
+    std::vector<CacheColumn> directory(n_columns);
+    std::memcpy(directory.data(), p + fixed, n_columns * sizeof(CacheColumn));
+
+    RawVector meta(p + meta_start, p + meta_start + meta_size);
+
+    SEXP source = PROTECT(R_MakeExternalPtr(new MappedPtr(file), R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(source, finalizeMapping, TRUE);
+
+    List columns(static_cast<R_xlen_t>(n_columns));
+    for (uint32_t k = 0; k < n_columns; k++) {
+        const CacheColumn& c = directory[k];
+        R_altrep_class_t cls;
+        switch (c.type) {
+        case INTSXP: cls = mapped_integer_class; break;
+        case LGLSXP: cls = mapped_logical_class; break;
+        case REALSXP: cls = mapped_real_class; break;
+        default:
+            UNPROTECT(1);
+            stop("%s is corrupted (column %d has an unknown type)", path, k + 1);
+        }
+        uint64_t bytes = c.length * elementSize(c.type);
+        if (c.offset % sizeof(double) != 0 || c.offset > size || bytes > size - c.offset) {
+            UNPROTECT(1);
+            stop("%s is truncated", path);
+        }
+        SET_VECTOR_ELT(columns, k, newMapped(cls, source, c.offset, c.length));
+    }
+
+    UNPROTECT(1);
+    return List::create(Named("meta") = meta, Named("columns") = columns);
+}
+
+// mappedString: returns a character vector with levels[codes], for a mapped
+// integer vector of (1-based) codes
+// [[Rcpp::export]]
+SEXP mappedString(SEXP codes, SEXP levels) {
+    if (TYPEOF(codes) != INTSXP || TYPEOF(levels) != STRSXP) {
+        Rcpp::stop("codes must be an integer vector and levels a character vector");
+    }
+    SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(data1, 0, codes);
+    SET_VECTOR_ELT(data1, 1, levels);
+    SEXP ret = R_new_altrep(mapped_string_class, data1, R_NilValue);
+    UNPROTECT(1);
+    return ret;
+}
+
+// [[Rcpp::init]]
+void initCache(DllInfo* dll) {
+
+    mapped_integer_class = R_make_altinteger_class("mapped_integer", "fpod", dll);
+    mapped_logical_class = R_make_altlogical_class("mapped_logical", "fpod", dll);
+    mapped_real_class = R_make_altreal_class("mapped_real", "fpod", dll);
+    mapped_string_class = R_make_altstring_class("mapped_string", "fpod", dll);
+
+    R_altrep_class_t* classes[] = {&mapped_integer_class, &mapped_logical_class,
+                                   &mapped_real_class};
+    for (R_altrep_class_t* cls : classes) {
+        R_set_altrep_Length_method(*cls, mappedLength);
+        R_set_altrep_Inspect_method(*cls, mappedInspect);
+        R_set_altvec_Dataptr_or_null_method(*cls, mappedDataptrOrNull);
+    }
+
+    R_set_altrep_Duplicate_method(mapped_integer_class, mappedDuplicate<&mapped_integer_class>);
+    R_set_altrep_Duplicate_method(mapped_logical_class, mappedDuplicate<&mapped_logical_class>);
+    R_set_altrep_Duplicate_method(mapped_real_class, mappedDuplicate<&mapped_real_class>);
+
+    R_set_altvec_Dataptr_method(mapped_integer_class, mappedDataptr<INTSXP>);
+    R_set_altinteger_Elt_method(mapped_integer_class, mappedIntegerElt);
+    R_set_altinteger_Get_region_method(mapped_integer_class, mappedGetRegion<int>);
+
+    R_set_altvec_Dataptr_method(mapped_logical_class, mappedDataptr<LGLSXP>);
+    R_set_altlogical_Elt_method(mapped_logical_class, mappedIntegerElt);
+    R_set_altlogical_Get_region_method(mapped_logical_class, mappedGetRegion<int>);
+
+    R_set_altvec_Dataptr_method(mapped_real_class, mappedDataptr<REALSXP>);
+    R_set_altreal_Elt_method(mapped_real_class, mappedRealElt);
+    R_set_altreal_Get_region_method(mapped_real_class, mappedGetRegion<double>);
+
+    R_set_altrep_Length_method(mapped_string_class, mappedStringLength);
+    R_set_altrep_Inspect_method(mapped_string_class, mappedStringInspect);
+    R_set_altrep_Duplicate_method(mapped_string_class, mappedStringDuplicate);
+    R_set_altvec_Dataptr_method(mapped_string_class, mappedStringDataptr);
+    R_set_altvec_Dataptr_or_null_method(mapped_string_class, mappedStringDataptrOrNull);
+    R_set_altstring_Elt_method(mapped_string_class, mappedStringElt);
+    R_set_altstring_Set_elt_method(mapped_string_class, mappedStringSetElt);
+}
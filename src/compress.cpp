@@ -0,0 +1,519 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include "altrep.h"
+#include <cmath> // for std::nearbyint
+#include <unordered_map>
+
+namespace {
+
+R_altrep_class_t delta_integer_class;
+R_altrep_class_t delta_time_class;
+
+// Delta encoding: values are split into blocks of 128. Each block stores its
+// first value (the base), and the differences between consecutive values,
+// zigzag encoded (so that small negative differences are small numbers too),
+// and bit packed with the smallest number of bits that fits all of them.
+// Since a block has 128 values, each block is a whole number of bytes.
+//
+// The encoding is a list with the number of values, the base, bit width and
+// byte offset of each block, and the bit packed data (followed by 8 bytes of
+// padding, so that any value can be read with a single 64-bit load).
+
+const R_xlen_t block_size = 128;
+const int max_width = 56;
+
+inline uint64_t zigzag(int64_t d) {
+    return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+inline int64_t unzigzag(uint64_t z) {
+    return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+// load64/store64: little-endian 64-bit access at any byte position
+inline uint64_t load64(const uint8_t* p) {
+    uint64_t w = 0;
+    for (int k = 7; k >= 0; k--) {
+        w = (w << 8) | p[k];
+    }
+    return w;
+}
+
+inline void store64(uint8_t* p, uint64_t w) {
+    for (int k = 0; k < 8; k++) {
+        p[k] = static_cast<uint8_t>(w >> (8 * k));
+    }
+}
+
+// encode: delta encodes value(0), ..., value(n-1). Returns NULL if some
+// difference needs more than max_width bits.
+template<class F>
+SEXP encode(R_xlen_t n, F value) {
+    R_xlen_t n_blocks = (n + block_size - 1) / block_size;
+    std::vector<double> bases(n_blocks);
+    std::vector<uint8_t> widths(n_blocks);
+    std::vector<double> offsets(n_blocks);
+    std::vector<uint8_t> data(8);
+
+    uint64_t z[block_size];
+    for (R_xlen_t k = 0; k < n_blocks; k++) {
+        R_xlen_t first = k * block_size;
+        R_xlen_t m = std::min(block_size, n - first);
+
+        int64_t prev = value(first);
+        uint64_t any = 0;
+        z[0] = 0;
+        for (R_xlen_t j = 1; j < block_size; j++) {
+            if (j < m) {
+                int64_t v = value(first + j);
+                z[j] = zigzag(v - prev);
+                prev = v;
+            } else {
+                z[j] = 0;
+            }
+            any |= z[j];
+        }
+
+        int width = 0;
+        while (width < 64 && (any >> width) != 0) {
+            width++;
+        }
+        if (width > max_width) {
+            return R_NilValue;
+        }
+
+        size_t offset = data.size() - 8;
+        bases[k] = static_cast<double>(value(first));
+        widths[k] = static_cast<uint8_t>(width);
+        offsets[k] = static_cast<double>(offset);
+        data.resize(data.size() + 16 * width);
+
+        uint8_t* p = data.data() + offset;
+        for (R_xlen_t j = 0; j < block_size && width > 0; j++) {
+            size_t pos = j * width;
+            uint64_t w = load64(p + pos / 8);
+            store64(p + pos / 8, w | (z[j] << (pos % 8)));
+        }
+    }
+
+    SEXP enc = PROTECT(Rf_allocVector(VECSXP, 5));
+    SET_VECTOR_ELT(enc, 0, Rf_ScalarReal(static_cast<double>(n)));
+    SET_VECTOR_ELT(enc, 1, Rcpp::wrap(bases));
+    SET_VECTOR_ELT(enc, 2, Rcpp::RawVector(widths.begin(), widths.end()));
+    SET_VECTOR_ELT(enc, 3, Rcpp::wrap(offsets));
+    SET_VECTOR_ELT(enc, 4, Rcpp::RawVector(data.begin(), data.end()));
+    UNPROTECT(1);
+    return enc;
+}
+
+R_xlen_t encodedLength(SEXP enc) {
+    return static_cast<R_xlen_t>(REAL(VECTOR_ELT(enc, 0))[0]);
+}
+
+// encodedSize: the number of bytes used by an encoding
+double encodedSize(SEXP enc) {
+    return 17.0 * Rf_xlength(VECTOR_ELT(enc, 1)) + Rf_xlength(VECTOR_ELT(enc, 4));
+}
+
+// decode: fills out with n values of an encoding, starting at value i
+void decode(SEXP enc, R_xlen_t i, R_xlen_t n, int64_t* out) {
+    const double* bases = REAL(VECTOR_ELT(enc, 1));
+    const Rbyte* widths = RAW(VECTOR_ELT(enc, 2));
+    const double* offsets = REAL(VECTOR_ELT(enc, 3));
+    const Rbyte* data = RAW(VECTOR_ELT(enc, 4));
+
+    R_xlen_t end = i + n;
+    while (i < end) {
+        R_xlen_t k = i / block_size;
+        R_xlen_t first = k * block_size;
+        R_xlen_t last = std::min(first + block_size, end);
+        int width = widths[k];
+        uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        const uint8_t* p = data + static_cast<size_t>(offsets[k]);
+
+        int64_t v = static_cast<int64_t>(bases[k]);
+        for (R_xlen_t j = first; j < last; j++) {
+            if (j > first && width > 0) {
+                size_t pos = (j - first) * width;
+                v += unzigzag((load64(p + pos / 8) >> (pos % 8)) & mask);
+            }
+            if (j >= i) {
+                *out++ = v;
+            }
+        }
+        i = last;
+    }
+}
+
+// The delta integer class keeps the encoding in data1. The time class keeps a
+// list with the encodings of the whole seconds and of the microseconds in
+// data1, and computes the time as seconds + microsec / 1e6, which is how
+// fp_read() computes it. Once R asks for a pointer to the data, the decoded
+// vector is kept in data2, and takes precedence from then on.
+
+bool isMaterialized(SEXP x) {
+    return R_altrep_data2(x) != R_NilValue;
+}
+
+R_xlen_t deltaLength(SEXP x) {
+    SEXP data1 = R_altrep_data1(x);
+    if (R_altrep_inherits(x, delta_time_class)) {
+        return encodedLength(VECTOR_ELT(data1, 0));
+    }
+    return encodedLength(data1);
+}
+
+void decodeInteger(SEXP x, R_xlen_t i, R_xlen_t n, int* out) {
+    int64_t buf[block_size];
+    for (R_xlen_t done = 0; done < n; done += block_size) {
+        R_xlen_t m = std::min(block_size, n - done);
+        decode(R_altrep_data1(x), i + done, m, buf);
+        for (R_xlen_t j = 0; j < m; j++) {
+            out[done + j] = static_cast<int>(buf[j]);
+        }
+    }
+}
+
+void decodeTime(SEXP x, R_xlen_t i, R_xlen_t n, double* out) {
+    SEXP data1 = R_altrep_data1(x);
+    int64_t seconds[block_size];
+    int64_t microsec[block_size];
+    for (R_xlen_t done = 0; done < n; done += block_size) {
+        R_xlen_t m = std::min(block_size, n - done);
+        decode(VECTOR_ELT(data1, 0), i + done, m, seconds);
+        decode(VECTOR_ELT(data1, 1), i + done, m, microsec);
+        for (R_xlen_t j = 0; j < m; j++) {
+            out[done + j] = static_cast<double>(seconds[j]) +
+                static_cast<double>(microsec[j]) / 1e6;
+        }
+    }
+}
+
+template<SEXPTYPE type>
+SEXP materialize(SEXP x) {
+    if (!isMaterialized(x)) {
+        R_xlen_t n = deltaLength(x);
+        SEXP data = PROTECT(Rf_allocVector(type, n));
+        if (type == INTSXP) {
+            decodeInteger(x, 0, n, INTEGER(data));
+        } else {
+            decodeTime(x, 0, n, REAL(data));
+        }
+        R_set_altrep_data2(x, data);
+        UNPROTECT(1);
+    }
+    return R_altrep_data2(x);
+}
+
+// methods shared by both delta classes
+
+Rboolean deltaInspect(SEXP x, int pre, int deep, int pvec,
+                      void (*inspect_subtree)(SEXP, int, int, int)) {
+    Rprintf(" fpod delta encoded vector%s\n",
+            isMaterialized(x) ? " (materialized)" : "");
+    return TRUE;
+}
+
+SEXP deltaSerializedState(SEXP x) {
+    // once materialized, the vector may have been modified, so serialize it
+    // as a regular vector
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    return R_altrep_data1(x);
+}
+
+template<R_altrep_class_t* cls>
+SEXP deltaUnserialize(SEXP, SEXP state) {
+    return R_new_altrep(*cls, state, R_NilValue);
+}
+
+template<R_altrep_class_t* cls>
+SEXP deltaDuplicate(SEXP x, Rboolean deep) {
+    // the encoding is never modified, so duplicates can share it
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    return R_new_altrep(*cls, R_altrep_data1(x), R_NilValue);
+}
+
+const void* deltaDataptrOrNull(SEXP x) {
+    if (!isMaterialized(x)) {
+        return NULL;
+    }
+    return DATAPTR_RO(R_altrep_data2(x));
+}
+
+int deltaNoNA(SEXP x) {
+    return isMaterialized(x) ? 0 : 1;
+}
+
+// integer
+
+void* deltaIntegerDataptr(SEXP x, Rboolean writeable) {
+    return INTEGER(materialize<INTSXP>(x));
+}
+
+int deltaIntegerElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return INTEGER(R_altrep_data2(x))[i];
+    }
+    int ret;
+    decodeInteger(x, i, 1, &ret);
+    return ret;
+}
+
+R_xlen_t deltaIntegerGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, int* buf) {
+    n = std::min(n, deltaLength(x) - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, INTEGER(R_altrep_data2(x)) + i, n * sizeof(int));
+    } else {
+        decodeInteger(x, i, n, buf);
+    }
+    return n;
+}
+
+// time
+
+void* deltaTimeDataptr(SEXP x, Rboolean writeable) {
+    return REAL(materialize<REALSXP>(x));
+}
+
+double deltaTimeElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return REAL(R_altrep_data2(x))[i];
+    }
+    double ret;
+    decodeTime(x, i, 1, &ret);
+    return ret;
+}
+
+R_xlen_t deltaTimeGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, double* buf) {
+    n = std::min(n, deltaLength(x) - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, REAL(R_altrep_data2(x)) + i, n * sizeof(double));
+    } else {
+        decodeTime(x, i, n, buf);
+    }
+    return n;
+}
+
+// isDelta: TRUE if x is a delta encoded integer vector that has not been
+// materialized
+bool isDelta(SEXP x) {
+    return ALTREP(x) && R_altrep_inherits(x, delta_integer_class) &&
+        !isMaterialized(x);
+}
+
+// packedWidth: the number of bytes needed to pack all values of x (all of
+// which must be whole numbers), or 0 if some are negative, NA or too large
+template<class T>
+int packedWidth(const T* x, R_xlen_t n) {
+    T max_value = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+        if (!(x[i] >= 0 && x[i] <= 65535 && x[i] == std::floor(x[i]))) {
+            return 0;
+        }
+        max_value = std::max(max_value, x[i]);
+    }
+    return max_value > 255 ? 2 : 1;
+}
+
+template<class T>
+SEXP pack(const T* x, R_xlen_t n, int width) {
+    Rcpp::RawVector storage(width * n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        if (width == 1) {
+            storage[i] = static_cast<Rbyte>(x[i]);
+        } else {
+            setU16(storage, i, static_cast<uint16_t>(x[i]));
+        }
+    }
+    return storage;
+}
+
+SEXP compressInteger(SEXP x) {
+    const int* p = INTEGER(x);
+    R_xlen_t n = Rf_xlength(x);
+    for (R_xlen_t i = 0; i < n; i++) {
+        if (p[i] == NA_INTEGER) {
+            return x;
+        }
+    }
+
+    // use whichever takes less memory: packed or delta encoded
+    int width = packedWidth(p, n);
+    SEXP enc = PROTECT(encode(n, [p](R_xlen_t i) { return p[i]; }));
+    double delta_size = Rf_isNull(enc) ? R_XLEN_T_MAX : encodedSize(enc);
+
+    SEXP ret = x;
+    if (width > 0 && width * n <= delta_size) {
+        ret = packedInteger(pack(p, n, width), width);
+    } else if (delta_size < 4.0 * n) {
+        ret = R_new_altrep(delta_integer_class, enc, R_NilValue);
+    }
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP compressString(SEXP x) {
+    R_xlen_t n = Rf_xlength(x);
+    std::unordered_map<SEXP, Rbyte> codes;
+    std::vector<SEXP> levels;
+    Rcpp::RawVector storage(n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        SEXP s = STRING_ELT(x, i);
+        auto it = codes.find(s);
+        if (it == codes.end()) {
+            if (levels.size() == 256) {
+                return x;
+            }
+            it = codes.emplace(s, static_cast<Rbyte>(levels.size())).first;
+            levels.push_back(s);
+        }
+        storage[i] = it->second;
+    }
+
+    SEXP levels_ = PROTECT(Rf_allocVector(STRSXP, levels.size()));
+    for (size_t i = 0; i < levels.size(); i++) {
+        SET_STRING_ELT(levels_, i, levels[i]);
+    }
+    SEXP ret = packedString(storage, levels_);
+    UNPROTECT(1);
+    return ret;
+}
+
+SEXP compressLogical(SEXP x) {
+    const int* p = LOGICAL(x);
+    R_xlen_t n = Rf_xlength(x);
+    Rcpp::RawVector storage(n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        if (p[i] == NA_LOGICAL) {
+            return x;
+        }
+        storage[i] = static_cast<Rbyte>(p[i]);
+    }
+    return packedLogical(storage);
+}
+
+SEXP compressReal(SEXP x) {
+    const double* p = REAL(x);
+    R_xlen_t n = Rf_xlength(x);
+    int width = packedWidth(p, n);
+    if (width == 0) {
+        return x;
+    }
+    return packedReal(pack(p, n, width), width);
+}
+
+} // namespace
+
+// compressColumn: returns x as a packed or delta encoded vector, whichever
+// takes less memory, or x itself if neither saves any memory (e.g. if x
+// contains NAs). Vectors that are already ALTREP vectors are not touched.
+// [[Rcpp::export]]
+SEXP compressColumn(SEXP x) {
+    if (ALTREP(x) || Rf_xlength(x) == 0) {
+        return x;
+    }
+
+    SEXP ret;
+    switch (TYPEOF(x)) {
+    case INTSXP: ret = compressInteger(x); break;
+    case LGLSXP: ret = compressLogical(x); break;
+    case REALSXP: ret = compressReal(x); break;
+    case STRSXP: ret = compressString(x); break;
+    default: ret = x;
+    }
+
+    if (ret != x) {
+        PROTECT(ret);
+        Rf_copyMostAttrib(x, ret);
+        UNPROTECT(1);
+    }
+    return ret;
+}
+
+// compressTime: returns time (as computed by fp_read(), i.e. whole seconds +
+// microsec / 1e6) as a delta encoded vector, or time itself if it can't be
+// recomputed exactly from microsec.
+// [[Rcpp::export]]
+SEXP compressTime(SEXP time, SEXP microsec) {
+    R_xlen_t n = Rf_xlength(time);
+    if (ALTREP(time) || TYPEOF(time) != REALSXP || TYPEOF(microsec) != INTSXP ||
+        Rf_xlength(microsec) != n || n == 0) {
+        return time;
+    }
+
+    const double* t = REAL(time);
+    std::vector<int64_t> seconds(n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        int us = INTEGER_ELT(microsec, i);
+        if (us == NA_INTEGER) {
+            return time;
+        }
+        double s = std::nearbyint(t[i] - us / 1e6);
+        if (std::isnan(s) || std::abs(s) > 1e15 || s + us / 1e6 != t[i]) {
+            return time;
+        }
+        seconds[i] = static_cast<int64_t>(s);
+    }
+
+    // the microseconds are shared with the microsec column, if it is encoded
+    SEXP us_enc;
+    if (isDelta(microsec)) {
+        us_enc = R_altrep_data1(microsec);
+    } else {
+        us_enc = encode(n, [microsec](R_xlen_t i) { return INTEGER_ELT(microsec, i); });
+    }
+    PROTECT(us_enc);
+    SEXP s_enc = PROTECT(encode(n, [&seconds](R_xlen_t i) { return seconds[i]; }));
+    if (Rf_isNull(us_enc) || Rf_isNull(s_enc)) {
+        UNPROTECT(2);
+        return time;
+    }
+
+    SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(data1, 0, s_enc);
+    SET_VECTOR_ELT(data1, 1, us_enc);
+    SEXP ret = PROTECT(R_new_altrep(delta_time_class, data1, R_NilValue));
+    Rf_copyMostAttrib(time, ret);
+    UNPROTECT(4);
+    return ret;
+}
+
+// [[Rcpp::init]]
+void initCompress(DllInfo* dll) {
+
+    delta_integer_class = R_make_altinteger_class("delta_integer", "fpod", dll);
+    delta_time_class = R_make_altreal_class("delta_time", "fpod", dll);
+
+    R_altrep_class_t* classes[] = {&delta_integer_class, &delta_time_class};
+    for (R_altrep_class_t* cls : classes) {
+        R_set_altrep_Length_method(*cls, deltaLength);
+        R_set_altrep_Inspect_method(*cls, deltaInspect);
+        R_set_altrep_Serialized_state_method(*cls, deltaSerializedState);
+        R_set_altvec_Dataptr_or_null_method(*cls, deltaDataptrOrNull);
+    }
+
+    R_set_altrep_Unserialize_method(delta_integer_class, deltaUnserialize<&delta_integer_class>);
+    R_set_altrep_Unserialize_method(delta_time_class, deltaUnserialize<&delta_time_class>);
+    R_set_altrep_Duplicate_method(delta_integer_class, deltaDuplicate<&delta_integer_class>);
+    R_set_altrep_Duplicate_method(delta_time_class, deltaDuplicate<&delta_time_class>);
+
+    R_set_altvec_Dataptr_method(delta_integer_class, deltaIntegerDataptr);
+    R_set_altinteger_Elt_method(delta_integer_class, deltaIntegerElt);
+    R_set_altinteger_Get_region_method(delta_integer_class, deltaIntegerGetRegion);
+    R_set_altinteger_No_NA_method(delta_integer_class, deltaNoNA);
+
+    R_set_altvec_Dataptr_method(delta_time_class, deltaTimeDataptr);
+    R_set_altreal_Elt_method(delta_time_class, deltaTimeElt);
+    R_set_altreal_Get_region_method(delta_time_class, deltaTimeGetRegion);
+    R_set_altreal_No_NA_method(delta_time_class, deltaNoNA);
+}
@@ -0,0 +1,329 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include "lazy.h"
+#include "altrep.h" // for R_ext/Altrep.h
+#include <algorithm> // for std::upper_bound
+#include <cmath> // for std::isnan
+
+void LazyClicks::addClick(R_xlen_t i, uint64_t record) {
+    uint64_t n = record - static_cast<uint64_t>(i);
+    if (n > UINT32_MAX) {
+        Rcpp::stop("File is too large to be read lazily");
+    }
+    skipped.push_back(static_cast<uint32_t>(n));
+}
+
+int LazyClicks::minute(R_xlen_t i) const {
+    auto it = std::upper_bound(minute_rows.begin(), minute_rows.end(), i);
+    return static_cast<int>(it - minute_rows.begin()) - 1;
+}
+
+void LazyClicks::decode(R_xlen_t i, fpod::ClickRecord& click) const {
+    uint64_t record = static_cast<uint64_t>(i) + skipped[i];
+    const uint8_t* buf = file->data() + format.header_size + record * format.record_size;
+    fpod::decodeClick(buf, format, click);
+}
+
+namespace {
+
+R_altrep_class_t lazy_integer_class;
+R_altrep_class_t lazy_real_class;
+
+const char* field_names[] = {
+    "microsec", "ncyc", "pkat", "clk_ipi_range", "ipi_pre_max", "ipi_at_max",
+    "khz", "amp_at_max", "amp_reversals", "duration", "time"
+};
+
+// The lazy vector classes keep a list with the external pointer to the
+// LazyClicks, the field, a lookup table (or NULL) and, for the time field, the
+// time of minute 0 in data1. Once R asks for a pointer to the data, the
+// decoded vector is kept in data2, and takes precedence from then on.
+
+SEXP newLazy(SEXP source, int field, SEXP table, SEXP origin) {
+    SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(data1, 0, source);
+    SET_VECTOR_ELT(data1, 1, Rf_ScalarInteger(field));
+    SET_VECTOR_ELT(data1, 2, table);
+    SET_VECTOR_ELT(data1, 3, origin);
+
+    bool is_real = field == LAZY_DURATION || field == LAZY_TIME;
+    if (table != R_NilValue) {
+        is_real = TYPEOF(table) == REALSXP;
+    }
+
+    SEXP ret = R_new_altrep(is_real ? lazy_real_class : lazy_integer_class,
+                            data1, R_NilValue);
+    UNPROTECT(1);
+    return ret;
+}
+
+const LazyClicks& clicksOf(SEXP x) {
+    return *lazyClicks(VECTOR_ELT(R_altrep_data1(x), 0));
+}
+
+int fieldOf(SEXP x) {
+    return INTEGER(VECTOR_ELT(R_altrep_data1(x), 1))[0];
+}
+
+SEXP tableOf(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 2);
+}
+
+double originOf(SEXP x) {
+    return REAL(VECTOR_ELT(R_altrep_data1(x), 3))[0];
+}
+
+bool isMaterialized(SEXP x) {
+    return R_altrep_data2(x) != R_NilValue;
+}
+
+bool isLazy(SEXP x) {
+    return ALTREP(x) && (R_altrep_inherits(x, lazy_integer_class) ||
+                         R_altrep_inherits(x, lazy_real_class));
+}
+
+R_xlen_t lazyLength(SEXP x) {
+    return clicksOf(x).skipped.size();
+}
+
+// fieldValue: returns a field of a decoded click record
+double fieldValue(const fpod::ClickRecord& click, int field) {
+    switch (field) {
+    case LAZY_MICROSEC: return click.microsec;
+    case LAZY_NCYC: return click.ncyc;
+    case LAZY_PKAT: return click.pkat;
+    case LAZY_CLK_IPI_RANGE: return click.clk_ipi_range;
+    case LAZY_IPI_PRE_MAX: return click.ipi_pre_max;
+    case LAZY_IPI_AT_MAX: return click.ipi_at_max;
+    case LAZY_KHZ: return click.khz;
+    case LAZY_AMP_AT_MAX: return click.amp_at_max;
+    case LAZY_AMP_REVERSALS: return click.amp_reversals;
+    default: return click.duration;
+    }
+}
+
+// lookup: returns table[value] (1-based, like R), or NA if out of range
+double lookup(SEXP table, double value) {
+    if (value < 1 || value > Rf_xlength(table)) {
+        return NA_REAL;
+    }
+    R_xlen_t i = static_cast<R_xlen_t>(value) - 1;
+    if (TYPEOF(table) == INTSXP) {
+        int x = INTEGER(table)[i];
+        return x == NA_INTEGER ? NA_REAL : x;
+    }
+    return REAL(table)[i];
+}
+
+inline void setValue(double value, double* out) {
+    *out = value;
+}
+
+inline void setValue(double value, int* out) {
+    *out = std::isnan(value) ? NA_INTEGER : static_cast<int>(value);
+}
+
+// decode: fills out with n elements of x, starting at element i
+template<class T>
+void decode(SEXP x, R_xlen_t i, R_xlen_t n, T* out) {
+    const LazyClicks& clicks = clicksOf(x);
+    int field = fieldOf(x);
+    SEXP table = tableOf(x);
+    double origin = field == LAZY_TIME ? originOf(x) : 0;
+
+    fpod::ClickRecord click;
+    for (R_xlen_t j = 0; j < n; j++) {
+        clicks.decode(i + j, click);
+        double value;
+        if (field == LAZY_TIME) {
+            value = origin + clicks.minute(i + j) * 60.0 + click.microsec / 1e6;
+        } else {
+            value = fieldValue(click, field);
+        }
+        if (table != R_NilValue) {
+            value = lookup(table, value);
+        }
+        setValue(value, out + j);
+    }
+}
+
+template<SEXPTYPE type>
+SEXP materialize(SEXP x) {
+    if (!isMaterialized(x)) {
+        R_xlen_t n = lazyLength(x);
+        SEXP data = PROTECT(Rf_allocVector(type, n));
+        if (type == INTSXP) {
+            decode(x, 0, n, INTEGER(data));
+        } else {
+            decode(x, 0, n, REAL(data));
+        }
+        R_set_altrep_data2(x, data);
+        UNPROTECT(1);
+    }
+    return R_altrep_data2(x);
+}
+
+// methods shared by both lazy vector classes
+
+Rboolean lazyInspect(SEXP x, int pre, int deep, int pvec,
+                     void (*inspect_subtree)(SEXP, int, int, int)) {
+    Rprintf(" fpod lazy vector (%s%s)\n", field_names[fieldOf(x)],
+            isMaterialized(x) ? ", materialized" : "");
+    return TRUE;
+}
+
+SEXP lazyDuplicate(SEXP x, Rboolean deep) {
+    // the mapped file is never modified, so duplicates can share it
+    if (isMaterialized(x)) {
+        return NULL;
+    }
+    SEXP data1 = R_altrep_data1(x);
+    return newLazy(VECTOR_ELT(data1, 0), fieldOf(x), tableOf(x),
+                   VECTOR_ELT(data1, 3));
+}
+
+const void* lazyDataptrOrNull(SEXP x) {
+    if (!isMaterialized(x)) {
+        return NULL;
+    }
+    return DATAPTR_RO(R_altrep_data2(x));
+}
+
+int lazyNoNA(SEXP x) {
+    // only lookup tables can give NAs
+    return !isMaterialized(x) && tableOf(x) == R_NilValue;
+}
+
+// integer
+
+void* lazyIntegerDataptr(SEXP x, Rboolean writeable) {
+    return INTEGER(materialize<INTSXP>(x));
+}
+
+int lazyIntegerElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return INTEGER(R_altrep_data2(x))[i];
+    }
+    int ret;
+    decode(x, i, 1, &ret);
+    return ret;
+}
+
+R_xlen_t lazyIntegerGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, int* buf) {
+    n = std::min(n, lazyLength(x) - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, INTEGER(R_altrep_data2(x)) + i, n * sizeof(int));
+    } else {
+        decode(x, i, n, buf);
+    }
+    return n;
+}
+
+// real
+
+void* lazyRealDataptr(SEXP x, Rboolean writeable) {
+    return REAL(materialize<REALSXP>(x));
+}
+
+double lazyRealElt(SEXP x, R_xlen_t i) {
+    if (isMaterialized(x)) {
+        return REAL(R_altrep_data2(x))[i];
+    }
+    double ret;
+    decode(x, i, 1, &ret);
+    return ret;
+}
+
+R_xlen_t lazyRealGetRegion(SEXP x, R_xlen_t i, R_xlen_t n, double* buf) {
+    n = std::min(n, lazyLength(x) - i);
+    if (isMaterialized(x)) {
+        std::memcpy(buf, REAL(R_altrep_data2(x)) + i, n * sizeof(double));
+    } else {
+        decode(x, i, n, buf);
+    }
+    return n;
+}
+
+void finalizeSource(SEXP source) {
+    delete lazyClicks(source);
+    R_ClearExternalPtr(source);
+}
+
+// checkLazy: stops unless x is a lazy vector that has not been materialized
+void checkLazy(SEXP x) {
+    if (!isLazy(x) || isMaterialized(x)) {
+        Rcpp::stop("x must be an unmodified lazy click column");
+    }
+}
+
+} // namespace
+
+SEXP lazySource(LazyClicks* clicks) {
+    SEXP source = PROTECT(R_MakeExternalPtr(clicks, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(source, finalizeSource, TRUE);
+    UNPROTECT(1);
+    return source;
+}
+
+LazyClicks* lazyClicks(SEXP source) {
+    return static_cast<LazyClicks*>(R_ExternalPtrAddr(source));
+}
+
+SEXP lazyColumn(SEXP source, LazyField field) {
+    return newLazy(source, field, R_NilValue, R_NilValue);
+}
+
+// lazyLookup: returns a lazy vector with table[x], for a lazy vector x. The
+// result has the same type as table.
+// [[Rcpp::export]]
+SEXP lazyLookup(SEXP x, SEXP table) {
+    checkLazy(x);
+    if (TYPEOF(table) != INTSXP && TYPEOF(table) != REALSXP) {
+        Rcpp::stop("table must be an integer or double vector");
+    }
+    SEXP data1 = R_altrep_data1(x);
+    return newLazy(VECTOR_ELT(data1, 0), fieldOf(x), table, R_NilValue);
+}
+
+// lazyTime: returns a lazy vector with the time of each click, in seconds
+// relative to the same origin as `origin`, which is the time of minute 0
+// [[Rcpp::export]]
+SEXP lazyTime(SEXP x, double origin) {
+    checkLazy(x);
+    SEXP data1 = R_altrep_data1(x);
+    SEXP origin_ = PROTECT(Rf_ScalarReal(origin));
+    SEXP ret = newLazy(VECTOR_ELT(data1, 0), LAZY_TIME, R_NilValue, origin_);
+    UNPROTECT(1);
+    return ret;
+}
+
+// [[Rcpp::init]]
+void initLazy(DllInfo* dll) {
+
+    lazy_integer_class = R_make_altinteger_class("lazy_integer", "fpod", dll);
+    lazy_real_class = R_make_altreal_class("lazy_real", "fpod", dll);
+
+    R_altrep_class_t* classes[] = {&lazy_integer_class, &lazy_real_class};
+    for (R_altrep_class_t* cls : classes) {
+        R_set_altrep_Length_method(*cls, lazyLength);
+        R_set_altrep_Inspect_method(*cls, lazyInspect);
+        R_set_altrep_Duplicate_method(*cls, lazyDuplicate);
+        R_set_altvec_Dataptr_or_null_method(*cls, lazyDataptrOrNull);
+    }
+
+    R_set_altvec_Dataptr_method(lazy_integer_class, lazyIntegerDataptr);
+    R_set_altinteger_Elt_method(lazy_integer_class, lazyIntegerElt);
+    R_set_altinteger_Get_region_method(lazy_integer_class, lazyIntegerGetRegion);
+    R_set_altinteger_No_NA_method(lazy_integer_class, lazyNoNA);
+
+    R_set_altvec_Dataptr_method(lazy_real_class, lazyRealDataptr);
+    R_set_altreal_Elt_method(lazy_real_class, lazyRealElt);
+    R_set_altreal_Get_region_method(lazy_real_class, lazyRealGetRegion);
+    R_set_altreal_No_NA_method(lazy_real_class, lazyNoNA);
+}
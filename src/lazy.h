@@ -0,0 +1,71 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#ifndef FPOD_LAZY_H
+#define FPOD_LAZY_H
+
+#include <Rcpp.h>
+#include <fpod/records.h> // for ClickRecord
+#include <fpod/mapped_file.h> // for MappedFile
+#include <memory> // for std::shared_ptr
+
+// lazy vectors are ordinary R vectors (integer or double) whose elements are
+// decoded from the click records of a memory mapped data file when accessed
+
+// LazyClicks: an index of the click records in a mapped data file
+struct LazyClicks {
+    std::shared_ptr<fpod::MappedFile> file;
+    fpod::Format format;
+
+    // for each click, the number of other records (train, wav and minute
+    // records) that precede it in the file
+    std::vector<uint32_t> skipped;
+
+    // for each minute record, the number of clicks that precede it
+    std::vector<R_xlen_t> minute_rows;
+
+    LazyClicks(std::shared_ptr<fpod::MappedFile> m_file,
+               const fpod::Format& m_format) :
+        file(m_file), format(m_format) {};
+
+    // addClick: adds click i, which is stored in the record with the given
+    // (0-based) record number
+    void addClick(R_xlen_t i, uint64_t record);
+
+    // minute: returns the minute of click i (-1 before the first minute record)
+    int minute(R_xlen_t i) const;
+
+    // decode: decodes the record of click i
+    void decode(R_xlen_t i, fpod::ClickRecord& click) const;
+};
+
+// the click columns that can be decoded lazily
+enum LazyField {
+    LAZY_MICROSEC,
+    LAZY_NCYC,
+    LAZY_PKAT,
+    LAZY_CLK_IPI_RANGE,
+    LAZY_IPI_PRE_MAX,
+    LAZY_IPI_AT_MAX,
+    LAZY_KHZ,
+    LAZY_AMP_AT_MAX,
+    LAZY_AMP_REVERSALS,
+    LAZY_DURATION,
+    LAZY_TIME
+};
+
+// lazySource: wraps clicks in an external pointer, which takes ownership
+SEXP lazySource(LazyClicks* clicks);
+
+// lazyClicks: returns the LazyClicks object of an external pointer
+LazyClicks* lazyClicks(SEXP source);
+
+// lazyColumn: returns a lazy vector with the given field of all clicks
+SEXP lazyColumn(SEXP source, LazyField field);
+
+#endif
@@ -0,0 +1,11 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+// the implementation of fpod::MappedFile, which must not see the R headers
+#define FPOD_MAPPED_FILE_IMPLEMENTATION
+#include <fpod/mapped_file.h>
@@ -0,0 +1,116 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include <Rcpp.h> // for interfacing with R
+#include <fpod.h> // for decoding data files
+#include <filesystem> // for path()
+
+const std::string getFiletype(const std::filesystem::path& file);
+Rcpp::List headerToList(const fpod::Header& h, const fpod::Format& format);
+
+namespace {
+
+// setTable: copies a lookup table of 256 values from R
+void setTable(std::array<double, 256>& table, const Rcpp::NumericVector& values,
+              const char* name) {
+    if (values.size() == 0) {
+        return;
+    }
+    if (values.size() != 256) {
+        Rcpp::stop("%s must have 256 values", name);
+    }
+    std::copy(values.begin(), values.end(), table.begin());
+}
+
+// InterruptibleOverview: checks for user interrupts while decoding
+struct InterruptibleOverview : fpod::Overview {
+    using fpod::Overview::Overview;
+    void progress(uint64_t, uint64_t) {
+        Rcpp::checkUserInterrupt();
+    }
+};
+
+} // namespace
+
+// [[Rcpp::export]]
+Rcpp::List overviewFPOD(const std::string file, int bin_minutes,
+                        Rcpp::NumericVector khz_table, Rcpp::NumericVector amp_table,
+                        Rcpp::NumericVector angle_table) {
+    using namespace Rcpp;
+    std::string basename(std::filesystem::path(file).filename().string());
+    fpod::Format format = fpod::getFormat(getFiletype(file));
+    fpod::MappedFile mapped_file(file);
+
+    if (!mapped_file.is_open()) {
+        stop("Unable to open file %s", basename);
+    }
+    if (!format.is_cpod() && !format.is_fpod()) {
+        stop("Unknown file type: %s", format.ext);
+    }
+    if (mapped_file.size() < format.header_size) {
+        stop("Unable to read from file");
+    }
+    if (bin_minutes < 1) {
+        stop("bin_minutes must be at least 1");
+    }
+
+    fpod::Header header = fpod::parseHeader(mapped_file.data(), format);
+    InterruptibleOverview overview(format, header, bin_minutes);
+    setTable(overview.khz_table, khz_table, "khz_table");
+    setTable(overview.amp_table, amp_table, "amp_table");
+    setTable(overview.angle_table, angle_table, "angle_table");
+
+    fpod::decodeRecords(mapped_file.data(), mapped_file.size(), format, header, overview);
+    overview.finish();
+
+    R_xlen_t n = static_cast<R_xlen_t>(overview.bins.size());
+    IntegerVector minute(n), minutes(n);
+    NumericVector clicks(n), amp_max(n), amp_median(n), khz(n);
+    NumericVector temp(n), angle(n), bat1(n), bat2(n);
+    std::vector<NumericVector> species;
+    for (std::size_t k = 0; k < fpod::species_names.size(); k++) {
+        species.push_back(NumericVector(n));
+    }
+
+    for (R_xlen_t i = 0; i < n; i++) {
+        const fpod::OverviewBin& b = overview.bins[i];
+        minute[i] = static_cast<int>(i * bin_minutes);
+        minutes[i] = b.minutes;
+        clicks[i] = static_cast<double>(b.clicks);
+        for (std::size_t k = 0; k < species.size(); k++) {
+            species[k][i] = static_cast<double>(b.species[k]);
+        }
+        amp_max[i] = b.clicks > 0 ? b.amp_max : NA_REAL;
+        amp_median[i] = b.clicks > 0 ? b.amp_median : NA_REAL;
+        khz[i] = b.clicks > 0 ? b.khz_sum / b.clicks : NA_REAL;
+        temp[i] = b.minutes > 0 ? b.temp_sum / b.minutes : NA_REAL;
+        angle[i] = b.minutes > 0 ? b.angle_sum / b.minutes : NA_REAL;
+        bat1[i] = b.minutes > 0 ? b.bat1_sum / b.minutes : NA_REAL;
+        bat2[i] = b.minutes > 0 ? b.bat2_sum / b.minutes : NA_REAL;
+    }
+
+    List bins = List::create(
+        Named("minute") = minute,
+        Named("minutes") = minutes,
+        Named("clicks") = clicks);
+    // the first species group is unclassified clicks, which are only counted
+    // in the total
+    for (std::size_t k = 1; k < species.size(); k++) {
+        bins.push_back(species[k], fpod::species_names[k]);
+    }
+    bins.push_back(amp_max, "amp_max");
+    bins.push_back(amp_median, "amp_median");
+    bins.push_back(khz, "khz_mean");
+    bins.push_back(temp, "degC");
+    bins.push_back(angle, "angle");
+    bins.push_back(bat1, "bat1v");
+    bins.push_back(bat2, "bat2v");
+
+    return List::create(Named("header") = headerToList(header, format),
+                        Named("bins") = bins);
+}
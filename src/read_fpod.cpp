@@ -7,36 +7,15 @@
 */
 
 #include <Rcpp.h> // for interfacing with R
-#include <fstream> // for reading files from the file system
+#include "altrep.h" // for packed (compact) column types
+#include "lazy.h" // for lazy column types
+#include <fpod.h> // for decoding data files
 #include <filesystem> // for file_size() and extension()
 #include <algorithm> // for std::transform
-#include <tuple> // to be able to cleanly return multiple values from functions
-
-bool eof(std::vector<uint8_t>& buf) {
-    static const uint8_t eof_code = 255;
-    size_t eof_count = std::count(buf.begin(), buf.end(), eof_code);
-    return eof_count >= buf.size() -5;
-}
-
-template<class T>
-T constructInt(const std::vector<uint8_t>& buf, const size_t offset, const size_t size) {
-    T res = 0;
-    if (offset+size < buf.size()) {
-        for (size_t i = 0; i < size; i++) {
-            res <<= 8;
-            res |= static_cast<T>(buf[offset+i]);
-        }
-    }
-    return res;
-}
-
-// parseString: combines length bytes from offset into a string
-std::string parseString(const std::vector<uint8_t>& buf, const size_t& offset,
-                        const size_t& length) {
-    const char* start_ptr = reinterpret_cast<const char*>(buf.data() + offset);
-    std::string result(start_ptr, length);
-    return result;
-}
+#include <atomic> // for cancelling background reads
+#include <chrono> // for timing the phases of a read
+#include <climits> // for INT_MAX
+#include <thread> // for background reads
 
 // getFiletype: returns the upper-case file extension after the dot
 const std::string getFiletype(const std::filesystem::path& file) {
@@ -48,55 +27,6 @@ const std::string getFiletype(const std::filesystem::path& file) {
     return ext;
 }
 
-// getBufSize: returns the header & data buffer sizes based on the file extension
-std::tuple<size_t, size_t> getBufsize(const std::string_view ext) {
-    size_t header_buf_size;
-    size_t data_buf_size;
-
-    if (ext == "CP1") {
-        header_buf_size = 360;
-        data_buf_size = 10;
-    } else if (ext == "CP3") {
-        header_buf_size = 720;
-        data_buf_size = 40;
-    } else {
-        header_buf_size = 1024;
-        data_buf_size = 16;
-    }
-
-    return {header_buf_size, data_buf_size};
-}
-
-// getSpeciesFromCode: maps FPOD species code to species groups
-std::string getSpeciesFromCode(const uint8_t code, std::string_view ext) {
-    static std::unordered_map<uint8_t, std::string> cpod_codes = {
-        {0, "NBHF"},
-        {1, "NBHF"},
-        {2, "OtherCet"},
-        {3, "OtherCet"},
-        {4, "Unclassed"},
-        {5, "Unclassed"},
-        {6, "Sonar"},
-        {7, "Sonar"}
-    };
-
-    static std::unordered_map<uint8_t, std::string> fpod_codes = {
-        {0, "NBHF"},
-        {1, "OtherCet"},
-        {2, "Unclassed"},
-        {3, "Sonar"}
-    };
-
-    if (ext == "CP3" && code <= 7) {
-        return cpod_codes[code];
-    } else if (ext == "FP3" && code <= 3) {
-        return fpod_codes[code];
-    } else {
-        return "";
-    }
-
-}
-
 struct WavDataChunk {
     std::vector<uint8_t> IPI;
     std::vector<uint8_t> SPL;
@@ -104,69 +34,114 @@ struct WavDataChunk {
 
 class WavData {
 public:
-    int click;
+    R_xlen_t click;
     std::vector<WavDataChunk> chunks;
-    WavData(int m_click): click(m_click) {};
+    WavData(R_xlen_t m_click): click(m_click) {};
 };
 
-Rcpp::DataFrame wavToList(std::vector<WavData>& wav_data) {
+// truncateVector: returns the first n elements of x. Unlike subsetting with an
+// index vector, this does not allocate an index, and works for long vectors.
+// If n is the length of x, x itself is returned, unless `copy` is true.
+template<class V>
+V truncateVector(const V& x, R_xlen_t n, bool copy = false) {
+    if (copy && n == Rf_xlength(x)) {
+        return V(Rf_duplicate(x));
+    }
+    return V(Rf_xlengthgets(x, n));
+}
+
+// compactSeq: returns from+1, ..., from+n as a compact (ALTREP) sequence,
+// which takes no memory until it is modified. Like 1:n in R, it is an integer
+// vector if possible, or a double vector if the numbers exceed INT_MAX.
+SEXP compactSeq(R_xlen_t from, R_xlen_t n) {
+    if (n == 0) {
+        return Rf_allocVector(INTSXP, 0);
+    }
+    SEXP first = PROTECT(Rf_ScalarReal(static_cast<double>(from + 1)));
+    SEXP last = PROTECT(Rf_ScalarReal(static_cast<double>(from + n)));
+    SEXP call = PROTECT(Rf_lang3(Rf_install(":"), first, last));
+    SEXP ret = Rf_eval(call, R_BaseEnv);
+    UNPROTECT(3);
+    return ret;
+}
+
+// asDataFrame: data.frames can't have more than INT_MAX rows, so longer tables
+// are returned as a plain list of (long) column vectors
+Rcpp::List asDataFrame(const Rcpp::List& columns, R_xlen_t nrow) {
+    if (nrow > INT_MAX) {
+        return columns;
+    }
+    return Rcpp::DataFrame(columns);
+}
+
+Rcpp::List wavToList(std::vector<WavData>& wav_data) {
 
     using namespace Rcpp;
 
-    size_t estimated_num_records(wav_data.size()*21);
-    IntegerVector click_num(estimated_num_records);
-    IntegerVector IPI(estimated_num_records);
-    IntegerVector SPL(estimated_num_records);
-    size_t pos = 0;
-    size_t total_records = 0;
+    R_xlen_t total_records = 0;
+    for (auto& wav : wav_data) {
+        total_records += wav.chunks.size() * 7;
+    }
+
+    // click numbers beyond INT_MAX only occur in (very) long FP1 files
+    bool long_clicks = !wav_data.empty() && wav_data.back().click > INT_MAX;
+    IntegerVector click_num(long_clicks ? 0 : total_records);
+    NumericVector click_num_long(long_clicks ? total_records : 0);
+    IntegerVector IPI(total_records);
+    IntegerVector SPL(total_records);
+    R_xlen_t pos = 0;
 
     for (auto& wav : wav_data) {
         for (auto it = wav.chunks.rbegin(); it != wav.chunks.rend(); ++it) {
             for (size_t j = 0; j < 7; j++) {
-                click_num[pos] = wav.click;
+                if (long_clicks) {
+                    click_num_long[pos] = static_cast<double>(wav.click);
+                } else {
+                    click_num[pos] = static_cast<int>(wav.click);
+                }
                 IPI[pos] = it->IPI[j];
                 SPL[pos] = it->SPL[j];
                 pos++;
-                total_records++;
             };
         }
     }
 
-    // use this to truncate down to actual data size
-    IntegerVector filter;
-    if (total_records > 0) {
-        filter = seq(0, total_records-1);
-    }
-
-    return DataFrame::create(
-        Named("click_no") = click_num[filter],
-        Named("IPI") = IPI[filter],
-        Named("SPL") = SPL[filter]
+    List wav = List::create(
+        Named("click_no") = long_clicks ? SEXP(click_num_long) : SEXP(click_num),
+        Named("IPI") = IPI,
+        Named("SPL") = SPL
     );
+    return asDataFrame(wav, total_records);
 }
 
+// ReadCancelled: thrown by the decoder's handler when a background read is
+// cancelled
+struct ReadCancelled : std::exception {};
+
 class FPODData {
 public:
-    // click data:
+    // click data. Fields that are stored as a single byte (or two) in the
+    // file are kept in raw vectors of the same width, and are only unpacked
+    // into R integer/logical/double/character vectors when returned to R.
     Rcpp::IntegerVector min;
     Rcpp::IntegerVector microsec;
-    Rcpp::IntegerVector click_no;
-    Rcpp::IntegerVector ncyc;
-    Rcpp::IntegerVector pkat;
-    Rcpp::IntegerVector clk_ipi_range;
-    Rcpp::IntegerVector ipi_pre_max;
-    Rcpp::IntegerVector ipi_at_max;
-    Rcpp::IntegerVector khz;
-    Rcpp::IntegerVector amp_at_max;
-    Rcpp::IntegerVector amp_reversals;
-    Rcpp::NumericVector duration;
-    Rcpp::LogicalVector has_wav;
+    Rcpp::RawVector ncyc;
+    Rcpp::RawVector pkat;
+    Rcpp::RawVector clk_ipi_range;
+    Rcpp::RawVector ipi_pre_max; // 2 bytes per click
+    Rcpp::RawVector ipi_at_max; // 2 bytes per click
+    Rcpp::RawVector khz;
+    Rcpp::RawVector amp_at_max;
+    Rcpp::RawVector amp_reversals;
+    Rcpp::RawVector duration; // 2 bytes per click (FPOD only)
+    Rcpp::NumericVector cpod_duration; // (CPOD only)
+    Rcpp::RawVector has_wav;
 
     // train data (if CP3/FP3):
-    Rcpp::IntegerVector train_id;
-    Rcpp::CharacterVector species;
-    Rcpp::IntegerVector quality_level;
-    Rcpp::LogicalVector echo;
+    Rcpp::RawVector train_id;
+    Rcpp::RawVector species; // index into species_names
+    Rcpp::RawVector quality_level;
+    Rcpp::RawVector echo;
 
     // wave data
     std::vector<WavData> wav_data;
@@ -185,69 +160,341 @@ public:
     Rcpp::List& header;
     int pic_code{0};
     int fgpa_code{0};
-    int last_click{0};
-
-    FPODData(std::uintmax_t max_clicks, Rcpp::List& m_header) :
+    fpod::Format format;
+    bool is_cpod;
+
+    // if true, packed columns are returned to R as compact (ALTREP) vectors
+    bool compact;
+
+    // if not NULL, the columns that are decoded from the click records are not
+    // stored, but returned to R as lazy (ALTREP) vectors, which decode them
+    // from the mapped file when needed
+    Rcpp::RObject lazy_source;
+    LazyClicks* lazy{nullptr};
+
+    // the click columns hold at most `capacity` clicks. When reading in chunks,
+    // full chunks are handed over to `chunk_callback` and the columns reused.
+    R_xlen_t capacity;
+    R_xlen_t n_clicks{0}; // number of clicks currently held in the columns
+    R_xlen_t first_click{0}; // number of clicks handed over in earlier chunks
+    Rcpp::Nullable<Rcpp::Function> chunk_callback;
+
+    // called as progress_callback(bytes_done, bytes_total) as the file is read
+    Rcpp::Nullable<Rcpp::Function> progress_callback;
+
+    // when decoding on a worker thread (see AsyncRead), R must not be called
+    // at all, and cancellation is requested through this flag instead
+    const std::atomic<bool>* cancelled{nullptr};
+
+    FPODData(R_xlen_t max_clicks, Rcpp::List& m_header,
+             const fpod::Format& m_format, bool m_compact = false,
+             Rcpp::Nullable<Rcpp::Function> m_chunk_callback = R_NilValue,
+             SEXP m_lazy_source = R_NilValue,
+             Rcpp::Nullable<Rcpp::Function> m_progress_callback = R_NilValue) :
         min(max_clicks),
-        microsec(max_clicks),
-        click_no(Rcpp::seq(1, max_clicks)),
-        ncyc(max_clicks),
-        pkat(max_clicks),
-        clk_ipi_range(max_clicks),
-        ipi_pre_max(max_clicks),
-        ipi_at_max(max_clicks),
-        khz(max_clicks),
-        amp_at_max(max_clicks),
-        amp_reversals(max_clicks),
-        duration(max_clicks),
+        microsec(decodedSize(max_clicks, m_lazy_source)),
+        ncyc(decodedSize(max_clicks, m_lazy_source)),
+        pkat(decodedSize(max_clicks, m_lazy_source)),
+        clk_ipi_range(decodedSize(max_clicks, m_lazy_source)),
+        ipi_pre_max(2 * decodedSize(max_clicks, m_lazy_source)),
+        ipi_at_max(2 * decodedSize(max_clicks, m_lazy_source)),
+        khz(decodedSize(max_clicks, m_lazy_source)),
+        amp_at_max(decodedSize(max_clicks, m_lazy_source)),
+        amp_reversals(decodedSize(max_clicks, m_lazy_source)),
+        duration(m_format.is_cpod() ? 0 : 2 * decodedSize(max_clicks, m_lazy_source)),
+        cpod_duration(m_format.is_cpod() ? decodedSize(max_clicks, m_lazy_source) : 0),
         has_wav(max_clicks),
         train_id(max_clicks),
         species(max_clicks),
         quality_level(max_clicks),
         echo(max_clicks),
-        header(m_header) {
+        header(m_header),
+        format(m_format),
+        is_cpod(m_format.is_cpod()),
+        compact(m_compact),
+        lazy_source(m_lazy_source),
+        capacity(max_clicks),
+        chunk_callback(m_chunk_callback),
+        progress_callback(m_progress_callback) {
+        if (!Rf_isNull(m_lazy_source)) {
+            lazy = lazyClicks(m_lazy_source);
+        }
     };
 
-    Rcpp::List toList() {
+    // decodedSize: the capacity of the columns that are decoded from the
+    // click records, which are not stored at all for lazy columns
+    static R_xlen_t decodedSize(R_xlen_t max_clicks, SEXP lazy_source) {
+        return Rf_isNull(lazy_source) ? max_clicks : 0;
+    }
+
+    // nextClick: returns the row index for the next click, handing over the
+    // current chunk first if the columns are full
+    R_xlen_t nextClick() {
+        if (n_clicks == capacity) {
+            if (chunk_callback.isNull()) {
+                Rcpp::stop("Click buffer overflow");
+            }
+            flush();
+        }
+        return n_clicks++;
+    }
+
+    // click, wav, minute and progress: the handler interface of
+    // fpod::decodeRecords()
+
+    // progress: called about once per MB of records. Interrupting a read
+    // throws from here, which unwinds (and unmaps) like any other error.
+    void progress(uint64_t bytes, uint64_t total) {
+        if (cancelled) {
+            if (*cancelled) {
+                throw ReadCancelled();
+            }
+            return;
+        }
+        Rcpp::checkUserInterrupt();
+        if (progress_callback.isNotNull()) {
+            Rcpp::Function callback(progress_callback.get());
+            callback(static_cast<double>(bytes), static_cast<double>(total));
+        }
+    }
+
+    void click(const fpod::ClickRef& ref) {
+        R_xlen_t i = nextClick();
+        min[i] = ref.minute;
+
+        if (lazy) {
+            lazy->addClick(i, ref.record);
+        } else {
+            fpod::ClickRecord click;
+            fpod::decodeClick(ref.data, format, click);
+            setClick(i, click);
+        }
+
+        if (ref.train) {
+            setTrain(i, *ref.train);
+        }
+    }
+
+    // wav: pseudo-wav data, which belongs to the click we just read
+    void wav(const fpod::WavRecord& record) {
+        if (n_clicks == 0) {
+            return;
+        }
+        R_xlen_t i = n_clicks - 1;
+
+        if (!has_wav[i]) {
+            has_wav[i] = 1;
+            // +1 since we're talking about click numbers, not indices
+            wav_data.emplace_back(WavData(first_click + i + 1));
+        }
+
+        WavDataChunk& chunk = wav_data.back().chunks.emplace_back();
+        for (int j = 0; j < 7; j++) {
+            chunk.IPI.push_back(record.ipi[j]);
+            chunk.SPL.push_back(record.spl[j]);
+        }
+    }
+
+    // minute: registers a minute record, which applies to the clicks that
+    // follow it
+    void minute(const fpod::EnvRecord& env) {
+        if (lazy) {
+            lazy->minute_rows.push_back(n_clicks);
+        }
+
+        temp_deg_c.push_back(env.temp_deg_c);
+        angle_x.push_back(env.angle);
+        bat1.push_back(env.bat1);
+        bat2.push_back(env.bat2);
+        bat_use.push_back(env.bat_use);
+        prior_min.push_back(env.prior_min);
+        next_min.push_back(env.next_min);
+    }
+
+    // setClick: stores a decoded click record at row i
+    void setClick(R_xlen_t i, const fpod::ClickRecord& click) {
+        microsec[i] = click.microsec;
+        ncyc[i] = click.ncyc;
+        pkat[i] = click.pkat;
+        clk_ipi_range[i] = click.clk_ipi_range;
+        setU16(ipi_pre_max, i, click.ipi_pre_max);
+        setU16(ipi_at_max, i, click.ipi_at_max);
+        khz[i] = click.khz;
+        amp_at_max[i] = click.amp_at_max;
+        amp_reversals[i] = click.amp_reversals;
+        if (is_cpod) {
+            cpod_duration[i] = click.duration;
+        } else {
+            setU16(duration, i, static_cast<uint16_t>(click.duration));
+        }
+    }
+
+    // setTrain: attaches click train data to the click at row i
+    void setTrain(R_xlen_t i, const fpod::TrainRecord& train) {
+        train_id[i] = train.train_id;
+        species[i] = train.species;
+        quality_level[i] = train.quality_level;
+        echo[i] = train.echo;
+    }
+
+    // flush: hands over the clicks (and wav data) read so far to the chunk
+    // callback, and resets the columns for the next chunk
+    void flush() {
+        if (n_clicks == 0 || chunk_callback.isNull()) {
+            return;
+        }
+
+        Rcpp::Function callback(chunk_callback.get());
+        Rcpp::List chunk;
+        chunk.push_back(header, "header");
+        chunk.push_back(wavToList(wav_data), "wav");
+        chunk.push_back(clicksToList(), "clicks");
+        callback(chunk);
+
+        first_click += n_clicks;
+        n_clicks = 0;
+        wav_data.clear();
+
+        // only some of the columns are written for every click
+        khz.fill(0);
+        cpod_duration.fill(0);
+        has_wav.fill(0);
+        train_id.fill(0);
+        species.fill(0);
+        quality_level.fill(0);
+        echo.fill(0);
+    }
+
+    // memoryUsage: the memory held by the click columns (as allocated, and
+    // the part of that in use), the wav data and the env data, in bytes. The
+    // click columns are allocated up front, so after decoding, this is the
+    // most that was held at any time.
+    Rcpp::NumericVector memoryUsage() const {
+        double per_click = 0;
+        double columns = 4.0 * (min.size() + microsec.size()) + 8.0 * cpod_duration.size();
+        for (const Rcpp::RawVector* raw : {&ncyc, &pkat, &clk_ipi_range, &ipi_pre_max,
+                                           &ipi_at_max, &khz, &amp_at_max, &amp_reversals,
+                                           &duration, &has_wav, &train_id, &species,
+                                           &quality_level, &echo}) {
+            columns += raw->size();
+        }
+        if (capacity > 0) {
+            per_click = columns / capacity;
+        }
+        if (lazy) {
+            columns += sizeof(uint32_t) * lazy->skipped.capacity() +
+                sizeof(R_xlen_t) * lazy->minute_rows.capacity();
+        }
+
+        double wav = wav_data.capacity() * sizeof(WavData);
+        for (const WavData& w : wav_data) {
+            wav += w.chunks.capacity() * sizeof(WavDataChunk);
+            for (const WavDataChunk& chunk : w.chunks) {
+                wav += chunk.IPI.capacity() + chunk.SPL.capacity();
+            }
+        }
+
+        double env = sizeof(int) * (temp_deg_c.capacity() + angle_x.capacity() +
+                                    bat1.capacity() + bat2.capacity() + bat_use.capacity()) +
+            (prior_min.capacity() + next_min.capacity()) / 8.0;
+
+        return Rcpp::NumericVector::create(
+            Rcpp::Named("click_columns") = columns,
+            Rcpp::Named("click_columns_used") = per_click * n_clicks,
+            Rcpp::Named("wav") = wav,
+            Rcpp::Named("env") = env);
+    }
+
+    // truncate: like truncateVector, but when reading in chunks, always
+    // returns a copy, since the columns are reused for the next chunk
+    template<class V>
+    V truncate(const V& x, R_xlen_t n) const {
+        return truncateVector(x, n, chunk_callback.isNotNull());
+    }
+
+    Rcpp::List clicksToList() {
 
         using namespace Rcpp;
 
-        // empty vector, so we can return an empty data.frame if no clicks were found.
-        IntegerVector filter;
+        // truncate down to actual data size
+        R_xlen_t n = n_clicks;
+
+        List clicks = List::create(
+            Named("minute") = truncate(min, n),
+            Named("microsec") = lazy ? lazyColumn(lazy_source, LAZY_MICROSEC) :
+                SEXP(truncate(microsec, n)),
+            Named("click_no") = compactSeq(first_click, n),
+            Named("train_id") = integerColumn(train_id, n),
+            Named("species") = speciesColumn(n),
+            Named("quality_level") = integerColumn(quality_level, n),
+            Named("echo") = logicalColumn(echo, n),
+            Named("ncyc") = decodedColumn(LAZY_NCYC, ncyc, n),
+            Named("pkat") = decodedColumn(LAZY_PKAT, pkat, n),
+            Named("clk_ipi_range") = decodedColumn(LAZY_CLK_IPI_RANGE, clk_ipi_range, n),
+            Named("ipi_pre_max") = decodedColumn(LAZY_IPI_PRE_MAX, ipi_pre_max, n, 2),
+            Named("ipi_at_max") = decodedColumn(LAZY_IPI_AT_MAX, ipi_at_max, n, 2),
+            Named("khz") = decodedColumn(LAZY_KHZ, khz, n),
+            Named("amp_at_max") = decodedColumn(LAZY_AMP_AT_MAX, amp_at_max, n),
+            Named("amp_reversals") = decodedColumn(LAZY_AMP_REVERSALS, amp_reversals, n),
+            Named("duration") = durationColumn(n),
+            Named("has_wav") = logicalColumn(has_wav, n)
+        );
+
+        return asDataFrame(clicks, n);
+    }
+
+    // *Column: truncates packed storage to n clicks, and returns it as a
+    // compact or regular R vector
 
-        // use this to truncate down to actual data size
-        if (last_click > -1) {
-            filter = seq(0, last_click);
+    SEXP integerColumn(const Rcpp::RawVector& storage, R_xlen_t n, int width = 1) {
+        Rcpp::RawVector packed(truncate(storage, width * n));
+        return compact ? packedInteger(packed, width) : unpackInteger(packed, width);
+    }
+
+    // decodedColumn: like integerColumn, but for the columns that are decoded
+    // from the click records, which may be lazy
+    SEXP decodedColumn(LazyField field, const Rcpp::RawVector& storage,
+                       R_xlen_t n, int width = 1) {
+        if (lazy) {
+            return lazyColumn(lazy_source, field);
+        }
+        return integerColumn(storage, n, width);
+    }
+
+    SEXP logicalColumn(const Rcpp::RawVector& storage, R_xlen_t n) {
+        Rcpp::RawVector packed(truncate(storage, n));
+        return compact ? packedLogical(packed) : unpackLogical(packed);
+    }
+
+    SEXP speciesColumn(R_xlen_t n) {
+        Rcpp::RawVector packed(truncate(species, n));
+        Rcpp::CharacterVector levels = Rcpp::wrap(fpod::species_names);
+        return compact ? packedString(packed, levels) : unpackString(packed, levels);
+    }
+
+    SEXP durationColumn(R_xlen_t n) {
+        if (lazy) {
+            return lazyColumn(lazy_source, LAZY_DURATION);
         }
+        if (is_cpod) {
+            return truncate(cpod_duration, n);
+        }
+        Rcpp::RawVector packed(truncate(duration, 2 * n));
+        return compact ? packedReal(packed, 2) : unpackReal(packed, 2);
+    }
+
+    Rcpp::List toList() {
+
+        using namespace Rcpp;
 
         List ret;
 
         ret.push_back(header, "header");
 
-        DataFrame clicks = DataFrame::create(
-            Named("minute") = min[filter],
-            Named("microsec") = microsec[filter],
-            Named("click_no") = click_no[filter],
-            Named("train_id") = train_id[filter],
-            Named("species") = species[filter],
-            Named("quality_level") = quality_level[filter],
-            Named("echo") = echo[filter],
-            Named("ncyc") = ncyc[filter],
-            Named("pkat") = pkat[filter],
-            Named("clk_ipi_range") = clk_ipi_range[filter],
-            Named("ipi_pre_max") = ipi_pre_max[filter],
-            Named("ipi_at_max") = ipi_at_max[filter],
-            Named("khz") = khz[filter],
-            Named("amp_at_max") = amp_at_max[filter],
-            Named("amp_reversals") = amp_reversals[filter],
-            Named("duration") = duration[filter],
-            Named("has_wav") = has_wav[filter]
-        );
-
         //if (temp_deg_c.size() > 0) {
 
             DataFrame env = DataFrame::create(
-                Named("minute") = seq(1, temp_deg_c.size()),
+                Named("minute") = compactSeq(0, temp_deg_c.size()),
                 Named("angle") = wrap(angle_x),
                 //Named("angle_x") = wrap(angle_x),
                 //Named("angle_y") = wrap(angle_y),
@@ -263,300 +510,401 @@ public:
             ret.push_back(env, "env");
         //}
 
-        ret.push_back(wavToList(wav_data), "wav");
-
-        ret.push_back(clicks, "clicks");
+        // in chunked mode, all clicks and wav data have already been handed over
+        if (chunk_callback.isNull()) {
+            ret.push_back(wavToList(wav_data), "wav");
+            ret.push_back(clicksToList(), "clicks");
+        }
 
         return ret;
     }
 };
 
-Rcpp::List getFPODHeader(std::vector<uint8_t>& buf, std::string_view ext) {
+// headerToList: returns the header as a list, with the fields that are stored
+// in files of the given format
+Rcpp::List headerToList(const fpod::Header& h, const fpod::Format& format) {
     Rcpp::List header;
-    header["pod_id"] = 100 * buf[3] + buf[4];
-    header["first_logged_min"] = constructInt<int32_t>(buf, 256, 4);
-    header["last_logged_min"] = constructInt<int32_t>(buf, 260, 4);
-    header["water_depth"] = (buf[131] << 8) + buf[132];
-    header["deployment_depth"] = (buf[129] << 8) + buf[130];
-    header["lat_text"] = parseString(buf, 133, 11);
-    header["lon_text"] = parseString(buf, 145, 11);
-    header["location_text"] =parseString(buf, 157, 30);
-    header["notes_text"] = parseString(buf, 188, 43);
-    header["gmt_text"] = parseString(buf, 232, 11);
-
-    int fpga_ver = buf[39] << 8 | buf[40];
-    header["pic_ver"] = buf[37];
-    header["fpga_ver"] = fpga_ver;
-
-    if (fpga_ver > 0) {
-        header["extended_amps"] = true;
+    if (format.is_cpod()) {
+        header["pod_id"] = h.pod_id;
     } else {
-        header["extended_amps"] = false;
+        header["pod_id"] = std::stoi(h.pod_id);
+    }
+    header["first_logged_min"] = h.first_logged_min;
+    header["last_logged_min"] = h.last_logged_min;
+    header["water_depth"] = h.water_depth;
+    header["deployment_depth"] = h.deployment_depth;
+    header["lat_text"] = h.lat_text;
+    header["lon_text"] = h.lon_text;
+    header["location_text"] = h.location_text;
+    header["notes_text"] = h.notes_text;
+
+    if (format.is_fpod()) {
+        header["gmt_text"] = h.gmt_text;
+        header["pic_ver"] = h.pic_ver;
+        header["fpga_ver"] = h.fpga_ver;
+        header["extended_amps"] = h.extended_amps;
     }
 
-    if (ext == "FP3") {
-        header["clicks_in_fp1"] = constructInt<int64_t>(buf, 231, 8);
+    if (format.ext == "FP3") {
+        header["clicks_in_fp1"] = static_cast<double>(h.source_clicks);
+    } else if (format.ext == "CP3") {
+        header["clicks_in_cp1"] = static_cast<double>(h.source_clicks);
     }
     return header;
 }
 
-Rcpp::List getCPODHeader(std::vector<uint8_t>& buf, std::string_view ext) {
-    Rcpp::List header;
-    header["pod_id"] = parseString(buf, 164, 4);
-    header["first_logged_min"] = constructInt<int32_t>(buf, 256, 4);
-    header["last_logged_min"] = constructInt<int32_t>(buf, 260, 4);
-    header["water_depth"] = (buf[31] << 8) | buf[32];
-    header["deployment_depth"] = (buf[29] << 8) | buf[30];
-    header["lat_text"] = parseString(buf, 13, 8);
-    header["lon_text"] = parseString(buf, 21, 8);
-    header["location_text"] = parseString(buf, 33, 31);
-    header["notes_text"] = parseString(buf, 211, 50);
-
-    if (ext == "CP3") {
-        header["clicks_in_cp1"] = constructInt<uint32_t>(buf, 128, 4);
+// vectorBytes: the memory held by the data of the (regular) R vectors in x,
+// recursively. ALTREP vectors (compact, packed and lazy columns) are not
+// counted, since they don't hold their data in the vector itself.
+double vectorBytes(SEXP x) {
+    if (ALTREP(x)) {
+        return 0;
+    }
+    switch (TYPEOF(x)) {
+    case VECSXP: {
+        double bytes = 0;
+        for (R_xlen_t i = 0; i < Rf_xlength(x); i++) {
+            bytes += vectorBytes(VECTOR_ELT(x, i));
+        }
+        return bytes;
+    }
+    case RAWSXP: return Rf_xlength(x);
+    case LGLSXP:
+    case INTSXP: return 4.0 * Rf_xlength(x);
+    case REALSXP: return 8.0 * Rf_xlength(x);
+    case STRSXP: return 1.0 * sizeof(SEXP) * Rf_xlength(x);
+    default: return 0;
     }
-    return header;
 }
 
-int getFPODData(std::ifstream& fid,
-                std::string_view ext,
-                size_t data_buf_size,
-                FPODData& dat) {
-
+// errorsToDataFrame: returns the problems found by a validating decode as a
+// data.frame, with the byte offset of each in the file
+Rcpp::DataFrame errorsToDataFrame(const std::vector<fpod::DecodeError>& errors,
+                                  const fpod::Format& format) {
     using namespace Rcpp;
+    R_xlen_t n = static_cast<R_xlen_t>(errors.size());
+    NumericVector record(n), offset(n), n_records(n);
+    IntegerVector minute(n);
+    CharacterVector reason(n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        const fpod::DecodeError& e = errors[i];
+        record[i] = static_cast<double>(e.record) + 1;
+        offset[i] = static_cast<double>(format.header_size + e.record * format.record_size);
+        n_records[i] = static_cast<double>(e.n_records);
+        minute[i] = e.minute;
+        reason[i] = e.reason;
+    }
+    return DataFrame::create(Named("record") = record, Named("offset") = offset,
+                             Named("n_records") = n_records, Named("minute") = minute,
+                             Named("reason") = reason,
+                             Named("stringsAsFactors") = false);
+}
 
-    std::vector<uint8_t> buf;
-    buf.resize(data_buf_size);
-
-    // starting at -1 makes the logic inside the loop below a lot nicer
-    int current_click = -1;
-    int current_min = -1;
-    int pic_ver = as<Rcpp::IntegerVector>(dat.header["pic_ver"])[0];
-    //int fpga_ver = as<Rcpp::IntegerVector>(dat.header["fpga_ver"])[0];
-
-    while (1) {
-
-        if (!fid.read(reinterpret_cast<char*>(&buf[0]), data_buf_size)) {
-            break;
-        } else {
-
-            size_t bytesActuallyRead = fid.gcount();
-
-            if (bytesActuallyRead < data_buf_size) {
-                break;
-            }
-
-            if (buf[0] < 184) {
-
-                // click data
-                current_click++;
-                dat.min[current_click] = current_min;
-                double microsec_d = static_cast<double>(constructInt<uint32_t>(buf, 0, 3) / 200.0 * 1000.0);
-                dat.microsec[current_click] = static_cast<int>(microsec_d);
-
-                dat.ncyc[current_click] = buf[3];
-                dat.pkat[current_click] = (buf[4] & 0xF0) >> 4;
-                if ((buf[4] & 0xF) == 15) {
-                    dat.clk_ipi_range[current_click] = 65;
-                } else if ((buf[4] & 0x8) == 8) {
-                    dat.clk_ipi_range[current_click] = (((buf[4] & 0x7) + 1) << 3);
-                } else {
-                    dat.clk_ipi_range[current_click] = (buf[4] & 0x7);
-                }
-                dat.ipi_pre_max[current_click] = buf[5] + 1;
-                dat.ipi_at_max[current_click] = buf[6] + 1;
-                dat.amp_at_max[current_click] = std::max(static_cast<uint8_t>(2), buf[10]);
-                dat.amp_reversals[current_click] = buf[13] & 15;
-                dat.duration[current_click] = ((buf[13] & 240) * 16 + buf[14])/5;
-
-            } else if (buf[0] == 249) {
-
-                // click train data precedes next click
-                dat.train_id[current_click+1] = buf[15]; // 1 to 255
-                dat.species[current_click+1] = getSpeciesFromCode((buf[14] >> 2) & 3, ext);
-                dat.quality_level[current_click+1] = buf[14] & 3;
-                dat.echo[current_click+1] = (buf[14] & 32) == 32 ? TRUE : FALSE;
-
-                //spGood[current_click+1] = (buf[14] & 64) == 64 ? TRUE : FALSE;
-                //rateGood[current_click+1] = (buf[14] & 128) == 128 ? TRUE : FALSE;
-
-            } else if (buf[0] == 250) {
-
-                // wav data precedes next click
-                // not sure why, but we have to use current_click here
-                // not current_click +1, which would be what I expect.
-                if (dat.has_wav[current_click] != TRUE) {
-                    dat.has_wav[current_click] = TRUE;
-                    // +2 since we're talking about click numbers, not indices,
-                    // and since we're also talking about the next click
-                    //dat.wav_data.emplace_back(WavData(current_click + 2));
-                    dat.wav_data.emplace_back(WavData(current_click + 1));
-                }
-
-                dat.wav_data.back().chunks.emplace_back();
-                for (int pos = 12; pos >= 0; pos -= 2) {
-                    dat.wav_data.back().chunks.back().IPI.push_back(buf[pos+1]);
-                    dat.wav_data.back().chunks.back().SPL.push_back(buf[pos+2]);
-                }
-
-            } else if (buf[0] == 254) {
-
-                current_min++;
+// NullHandler: a handler that ignores all records, for validating a file
+// without reading it
+struct NullHandler {
+    void click(const fpod::ClickRef&) {}
+    void wav(const fpod::WavRecord&) {}
+    void minute(const fpod::EnvRecord&) {}
+    void progress(uint64_t, uint64_t) {
+        Rcpp::checkUserInterrupt();
+    }
+};
 
-                dat.temp_deg_c.push_back(static_cast<int>(buf[7]));
+// secondsSince: the wall time since start, in seconds
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-                dat.angle_x.push_back(buf[3]);
-                //dat.angle_y.push_back(buf[4]);
-                //dat.angle_z.push_back(buf[5]);
+// openDataFile: maps a data file of the given format, and checks that it is
+// one that can be read
+std::shared_ptr<fpod::MappedFile> openDataFile(const std::string& file,
+                                               const fpod::Format& format) {
+    std::string basename(std::filesystem::path(file).filename().string());
+    auto mapped_file = std::make_shared<fpod::MappedFile>(file);
 
-                if (pic_ver < 28 && buf[11] == 0 && buf[13]) {
-                    dat.bat1.push_back(buf[12]);
-                    dat.bat2.push_back(buf[13]);
-                } else {
-                    dat.bat1.push_back(buf[11]);
-                    dat.bat2.push_back(buf[12]);
-                }
+    if (!mapped_file->is_open()) {
+        Rcpp::stop("Unable to open file %s", basename);
+    }
 
-                if ((buf[10] & 2) == 0) {
-                    dat.bat_use.push_back(1);
-                } else {
-                    dat.bat_use.push_back(2);
-                }
+    if (mapped_file->size() < format.header_size) {
+        Rcpp::stop("Unable to read from file");
+    }
 
-                //dat.bat_use.push_back(1+((buf[10] & 2) == 0));
-                dat.prior_min.push_back(buf[10] & 1);
-                dat.next_min.push_back((buf[10] >> 2) & 1);
+    if (!format.is_cpod() && !format.is_fpod()) {
+        Rcpp::stop("Unknown file type: %s", format.ext);
+    }
 
-            }
-        }
+    // the number of records is the largest possible number of clicks
+    if ((mapped_file->size() - format.header_size) / format.record_size >
+        static_cast<std::uintmax_t>(R_XLEN_T_MAX)) {
+        Rcpp::stop("File %s is too large", basename);
     }
-    dat.last_click = current_click;
-    return current_click;
+    return mapped_file;
 }
 
-int getCPODData(std::ifstream& fid,
-                       std::string_view ext,
-                       size_t data_buf_size,
-                       FPODData& dat) {
+// [[Rcpp::export]]
+Rcpp::List readFPOD(const std::string file, bool compact = false,
+                    double chunk_size = 0,
+                    Rcpp::Nullable<Rcpp::Function> callback = R_NilValue,
+                    bool lazy = false, bool profile = false,
+                    Rcpp::Nullable<Rcpp::Function> progress = R_NilValue,
+                    bool validate = false, int sample = 0) {
 
     using namespace Rcpp;
+    auto start = std::chrono::steady_clock::now();
+    fpod::Format format = fpod::getFormat(getFiletype(file));
+    auto mapped_file = openDataFile(file, format);
 
-    std::vector<uint8_t> buf;
-    buf.resize(data_buf_size);
+    // get an estimate of the maximum possible number of clicks
+    // in reality, it will always be less than this, because of train/wav data
+    // being interspersed among clicks
+    std::uintmax_t max_clicks = (mapped_file->size() - format.header_size) /
+        format.record_size;
+
+    // when reading in chunks, the click columns only need to hold one chunk
+    R_xlen_t capacity = static_cast<R_xlen_t>(max_clicks);
+    if (callback.isNotNull()) {
+        if (lazy) {
+            stop("Lazy columns can't be read in chunks");
+        }
+        if (chunk_size < 1) {
+            stop("chunk_size must be at least 1");
+        }
+        if (chunk_size < capacity) {
+            capacity = static_cast<R_xlen_t>(chunk_size);
+        }
+    }
 
-    // starting at -1 makes the logic inside the loop below a lot nicer
-    int current_click = -1;
-    int current_min = -1;
-    int file_ends = 0;
-    size_t last_byte = data_buf_size -1;
+    // when sampling, only every sample-th minute is decoded, so the click
+    // columns only need to hold the records of those minutes
+    std::vector<uint64_t> minute_records;
+    std::vector<int> sampled_minutes;
+    if (sample > 0) {
+        if (lazy || callback.isNotNull() || validate) {
+            stop("Sampled reads can't be lazy, chunked or validated");
+        }
+        minute_records = fpod::findMinutes(mapped_file->data(), mapped_file->size(), format);
+        std::uintmax_t sampled_records = 0;
+        for (std::size_t k = 0; k < minute_records.size(); k += sample) {
+            sampled_minutes.push_back(static_cast<int>(k));
+            std::uintmax_t end = k + 1 < minute_records.size() ? minute_records[k + 1] :
+                max_clicks;
+            sampled_records += end - minute_records[k] - 1;
+        }
+        capacity = static_cast<R_xlen_t>(sampled_records);
+    }
 
-    while (1) {
+    // lazy columns keep the file mapped for as long as they are in use
+    RObject lazy_source;
+    if (lazy) {
+        lazy_source = lazySource(new LazyClicks(mapped_file, format));
+        lazyClicks(lazy_source)->skipped.reserve(capacity);
+    }
 
-        if (!fid.read(reinterpret_cast<char*>(&buf[0]), data_buf_size)) {
-            break;
-        } else {
-            size_t bytesActuallyRead = fid.gcount();
+    // read header data
+    fpod::Header file_header = fpod::parseHeader(mapped_file->data(), format);
+    List header = headerToList(file_header, format);
+    header["filename"] = CharacterVector(file);
 
-            if (bytesActuallyRead < data_buf_size) {
-                break;
-            }
+    double open_seconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
 
-            // In CP3 files, the end of data is indicated by two consecutive
-            // data chunks where all values are 255.
-            if (eof(buf)) {
-                if (++file_ends == 2) {
-                    break;
-                }
-                //continue;
-            } else {
-                file_ends = 0;
-            }
+    FPODData fpod_data(capacity, header, format, compact, callback, lazy_source, progress);
+    std::vector<fpod::DecodeError> errors;
+    if (sample > 0) {
+        fpod::decodeMinutes(mapped_file->data(), mapped_file->size(), format,
+                            file_header, fpod_data, minute_records, sampled_minutes);
+    } else {
+        fpod::decodeRecords(mapped_file->data(), mapped_file->size(), format,
+                            file_header, fpod_data, validate ? &errors : nullptr);
+    }
+    fpod_data.flush();
 
-            if (buf[last_byte] != 254) {
+    if (lazy) {
+        lazyClicks(lazy_source)->skipped.shrink_to_fit();
+    }
 
-                // click data
-                current_click++;
-                dat.min[current_click] = current_min;
-                double microsec_d = static_cast<double>(constructInt<uint32_t>(buf, 0, 3) / 200.0 * 1000.0);
-                dat.microsec[current_click] = static_cast<int>(microsec_d);
+    double decode_seconds = secondsSince(start);
+    NumericVector memory = profile ? fpod_data.memoryUsage() : NumericVector(0);
+    start = std::chrono::steady_clock::now();
 
-                dat.ncyc[current_click] = buf[3];
-                dat.khz[current_click] = buf[5];
-                dat.amp_at_max[current_click] = buf[5];
+    List ret = fpod_data.toList();
+    if (validate) {
+        ret.attr("errors") = errorsToDataFrame(errors, format);
+    }
 
-                if (buf[5] > 0) {
-                    dat.duration[current_click] = static_cast<double>(buf[3]) / static_cast<double>(buf[5]);
-                }
+    if (profile) {
+        // the record counts come from a separate pass over the (mapped) file,
+        // which is not included in the times
+        double convert_seconds = secondsSince(start);
+
+        // the decoder's columns are only freed after the conversion to R
+        // vectors, which copies them
+        double convert_bytes = vectorBytes(ret);
+        double peak_bytes = memory[0] + memory[2] + memory[3] + convert_bytes; // all but used
+        memory.push_back(convert_bytes, "convert");
+
+        fpod::RecordCounts counts = fpod::countRecords(mapped_file->data(),
+                                                       mapped_file->size(), format);
+        ret.attr("profile") = List::create(
+            Named("seconds") = NumericVector::create(
+                Named("open") = open_seconds,
+                Named("decode") = decode_seconds,
+                Named("convert") = convert_seconds),
+            Named("bytes_read") = static_cast<double>(mapped_file->size()),
+            Named("records") = NumericVector::create(
+                Named("click") = static_cast<double>(counts.clicks),
+                Named("train") = static_cast<double>(counts.trains),
+                Named("wav") = static_cast<double>(counts.wav),
+                Named("minute") = static_cast<double>(counts.minutes),
+                Named("unknown") = static_cast<double>(counts.other)),
+            Named("memory") = memory,
+            Named("peak_bytes") = peak_bytes
+        );
+    }
+    return ret;
+}
 
-                if (ext == "CP3") {
-                    dat.train_id[current_click] = buf[39];
-                    dat.species[current_click] = getSpeciesFromCode(buf[36] >> 3, ext);
-                    dat.quality_level[current_click] = buf[36] & 3;
-                }
+// [[Rcpp::export]]
+Rcpp::DataFrame validateFPOD(const std::string file) {
+    std::string basename(std::filesystem::path(file).filename().string());
+    fpod::Format format = fpod::getFormat(getFiletype(file));
+    fpod::MappedFile mapped_file(file);
 
-            } else if (buf[last_byte] == 254) {
-                // minute data
-                current_min++;
-                dat.angle_x.push_back(buf[4]);
-                dat.temp_deg_c.push_back((buf[3]+2) / 5); // +2 to round to nearest int
-                dat.bat1.push_back(buf[3]);
-                dat.bat2.push_back(buf[4]);
-
-                // hard-coded defaults for now
-                dat.prior_min.push_back(1);
-                dat.next_min.push_back(0); // not used for cpod
-                dat.bat_use.push_back(1); // not used for cpod
-            }
-        }
+    if (!mapped_file.is_open()) {
+        Rcpp::stop("Unable to open file %s", basename);
+    }
+    if (!format.is_cpod() && !format.is_fpod()) {
+        Rcpp::stop("Unknown file type: %s", format.ext);
+    }
+
+    std::vector<fpod::DecodeError> errors;
+    if (mapped_file.size() < format.header_size) {
+        errors.push_back({0, 0, 0, "truncated header"});
+    } else {
+        fpod::Header header = fpod::parseHeader(mapped_file.data(), format);
+        NullHandler handler;
+        fpod::decodeRecords(mapped_file.data(), mapped_file.size(), format, header,
+                            handler, &errors);
     }
-    dat.last_click = current_click-1;
-    return current_click-1;
+    return errorsToDataFrame(errors, format);
 }
 
 // [[Rcpp::export]]
-Rcpp::List readFPOD(const std::string file) {
+Rcpp::LogicalVector prefetchFiles(const std::vector<std::string> files) {
+    Rcpp::LogicalVector ret(files.size());
+    for (std::size_t i = 0; i < files.size(); i++) {
+        ret[i] = fpod::prefetchFile(files[i]);
+    }
+    return ret;
+}
 
-    using namespace Rcpp;
-    std::string basename(std::filesystem::path(file).filename().string());
-    std::string ext(getFiletype(file));
-    auto [header_buf_size, data_buf_size] = getBufsize(ext);
-    std::ifstream fid(file.c_str(), std::ios::binary);
+// AsyncRead: a read that decodes on a worker thread, so that R stays
+// responsive. The click columns (R vectors) are allocated on the main thread
+// before the worker starts, and the worker only writes to their memory
+// without calling R. Converting the result to R objects happens on the main
+// thread again, in value().
+class AsyncRead {
+public:
+    AsyncRead(const std::string& file, bool compact) :
+        format(fpod::getFormat(getFiletype(file))),
+        mapped_file(openDataFile(file, format)),
+        file_header(fpod::parseHeader(mapped_file->data(), format)),
+        header(headerToList(file_header, format)) {
+        header["filename"] = Rcpp::CharacterVector(file);
+        R_xlen_t capacity = static_cast<R_xlen_t>(
+            (mapped_file->size() - format.header_size) / format.record_size);
+        data = std::make_unique<FPODData>(capacity, header, format, compact);
+        data->cancelled = &cancelled;
+        worker = std::thread([this] { decode(); });
+    }
 
-    if (!fid.is_open()) {
-        stop("Unable to open file %s", basename);
+    ~AsyncRead() {
+        cancel();
     }
 
-    // get an estimate of the maximum possible number of clicks
-    // in reality, it will always be less than this, because of train/wav data
-    // being interspersed among clicks
-    std::uintmax_t max_clicks = (std::filesystem::file_size(file) - header_buf_size) / data_buf_size;
-    std::vector<uint8_t> buf(header_buf_size);
+    bool ready() const { return done; }
 
-    if (!fid.read(reinterpret_cast<char*>(&buf[0]), header_buf_size)) {
-        stop("Unable to read from file");
+    // cancel: stops the worker (within about a MB of records)
+    void cancel() {
+        cancelled = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
 
-    // read header data
-    List header;
-    List data;
-    FPODData fpod_data(max_clicks, header);
-
-    if (ext == "CP1" || ext == "CP3") {
-        header = getCPODHeader(buf, ext);
-        fpod_data.last_click = getCPODData(fid, ext, data_buf_size, fpod_data);
-    } else if (ext == "FP1" || ext == "FP3") {
-        header = getFPODHeader(buf, ext);
-        fpod_data.last_click = getFPODData(fid, ext, data_buf_size, fpod_data);
-    } else {
-        stop("Unknown file type: %s", ext);
+    // value: waits for the worker to finish, and returns the result
+    Rcpp::List value() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (!done) {
+            Rcpp::stop("The read was cancelled");
+        }
+        if (!error.empty()) {
+            Rcpp::stop(error);
+        }
+        if (data) {
+            result = data->toList();
+            // the decoder's columns and the mapping are no longer needed
+            data.reset();
+            mapped_file.reset();
+        }
+        return result;
     }
 
-    fid.close();
+private:
+    void decode() {
+        try {
+            fpod::decodeRecords(mapped_file->data(), mapped_file->size(), format,
+                                file_header, *data);
+            done = true;
+        } catch (const ReadCancelled&) {
+            // done stays false
+        } catch (const std::exception& e) {
+            error = e.what();
+            done = true;
+        }
+    }
 
-    header["filename"] = CharacterVector(file);
-    return fpod_data.toList();
-    //return List::create();
+    fpod::Format format;
+    std::shared_ptr<fpod::MappedFile> mapped_file;
+    fpod::Header file_header;
+    Rcpp::List header;
+    std::unique_ptr<FPODData> data;
+    Rcpp::List result;
+    std::thread worker;
+    std::atomic<bool> done{false};
+    std::atomic<bool> cancelled{false};
+    std::string error;
+};
+
+// asyncRead: the AsyncRead behind a handle returned by readFPODAsync()
+AsyncRead* asyncRead(SEXP handle) {
+    AsyncRead* read = static_cast<AsyncRead*>(R_ExternalPtrAddr(handle));
+    if (read == nullptr) {
+        Rcpp::stop("Invalid read handle");
+    }
+    return read;
 }
 
+// [[Rcpp::export]]
+SEXP readFPODAsync(const std::string file, bool compact = false) {
+    return Rcpp::XPtr<AsyncRead>(new AsyncRead(file, compact), true);
+}
 
+// [[Rcpp::export]]
+bool asyncReady(SEXP handle) {
+    return asyncRead(handle)->ready();
+}
+
+// [[Rcpp::export]]
+Rcpp::List asyncValue(SEXP handle) {
+    return asyncRead(handle)->value();
+}
 
+// [[Rcpp::export]]
+void asyncCancel(SEXP handle) {
+    asyncRead(handle)->cancel();
+}
@@ -0,0 +1,134 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include <Rcpp.h>
+#include <cmath> // for std::llround
+#include <cstring> // for std::memcpy
+#include <limits>
+
+namespace {
+
+// integer64 vectors (as in package bit64) are double vectors that hold 64-bit
+// integers, with the smallest integer as NA
+const int64_t na_integer64 = std::numeric_limits<int64_t>::min();
+
+const int64_t ns_per_sec = 1000000000;
+const int64_t ns_per_min = 60 * ns_per_sec;
+const int64_t ns_per_microsec = 1000;
+
+inline int64_t getInteger64(const double* x, R_xlen_t i) {
+    int64_t value;
+    std::memcpy(&value, x + i, sizeof(value));
+    return value;
+}
+
+inline void setInteger64(double* x, R_xlen_t i, int64_t value) {
+    std::memcpy(x + i, &value, sizeof(value));
+}
+
+SEXP allocInteger64(R_xlen_t n) {
+    SEXP ret = PROTECT(Rf_allocVector(REALSXP, n));
+    Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("integer64"));
+    UNPROTECT(1);
+    return ret;
+}
+
+}
+
+// clickTimeNs: returns the time of each click as integer64 nanoseconds since
+// 1970-01-01 UTC, from the minute and microsecond of each click, and the time
+// of minute 0 in (whole) seconds since 1970-01-01. All the arithmetic is done
+// in integers, so the result is exact.
+// [[Rcpp::export]]
+SEXP clickTimeNs(SEXP minute, SEXP microsec, double origin) {
+    R_xlen_t n = Rf_xlength(minute);
+    if (Rf_xlength(microsec) != n) {
+        Rcpp::stop("minute and microsec must have the same length");
+    }
+
+    int64_t origin_ns = std::llround(origin) * ns_per_sec;
+    SEXP ret = PROTECT(allocInteger64(n));
+    double* out = REAL(ret);
+
+    for (R_xlen_t i = 0; i < n; i++) {
+        int min = INTEGER_ELT(minute, i);
+        int us = INTEGER_ELT(microsec, i);
+        if (min == NA_INTEGER || us == NA_INTEGER) {
+            setInteger64(out, i, na_integer64);
+        } else {
+            setInteger64(out, i, origin_ns + min * ns_per_min + us * ns_per_microsec);
+        }
+    }
+
+    UNPROTECT(1);
+    return ret;
+}
+
+// clickIntervals: returns the difference between each time and the one before
+// it (NA for the first), either as integer64 (for integer64 times), or as
+// double (for POSIXct and other double times)
+// [[Rcpp::export]]
+SEXP clickIntervals(SEXP time) {
+    if (TYPEOF(time) != REALSXP) {
+        Rcpp::stop("time must be a POSIXct or integer64 vector");
+    }
+
+    R_xlen_t n = Rf_xlength(time);
+    const double* x = REAL(time);
+
+    if (Rf_inherits(time, "integer64")) {
+        SEXP ret = PROTECT(allocInteger64(n));
+        double* out = REAL(ret);
+        for (R_xlen_t i = 0; i < n; i++) {
+            int64_t cur = getInteger64(x, i);
+            int64_t prev = i > 0 ? getInteger64(x, i - 1) : na_integer64;
+            if (cur == na_integer64 || prev == na_integer64) {
+                setInteger64(out, i, na_integer64);
+            } else {
+                setInteger64(out, i, cur - prev);
+            }
+        }
+        UNPROTECT(1);
+        return ret;
+    }
+
+    SEXP ret = PROTECT(Rf_allocVector(REALSXP, n));
+    double* out = REAL(ret);
+    for (R_xlen_t i = 0; i < n; i++) {
+        out[i] = i > 0 ? x[i] - x[i - 1] : NA_REAL;
+    }
+    UNPROTECT(1);
+    return ret;
+}
+
+// integer64ToDouble: converts integer64 values to doubles, in units of `unit`
+// (e.g. 1e9 to get seconds from nanoseconds). The whole units are converted
+// separately from the remainder, so that whole seconds (or minutes) stay whole.
+// [[Rcpp::export]]
+SEXP integer64ToDouble(SEXP x, double unit) {
+    R_xlen_t n = Rf_xlength(x);
+    const double* in = REAL(x);
+    int64_t d = std::llround(unit);
+    if (d < 1) {
+        Rcpp::stop("unit must be a positive integer");
+    }
+
+    SEXP ret = PROTECT(Rf_allocVector(REALSXP, n));
+    double* out = REAL(ret);
+    for (R_xlen_t i = 0; i < n; i++) {
+        int64_t value = getInteger64(in, i);
+        if (value == na_integer64) {
+            out[i] = NA_REAL;
+        } else {
+            out[i] = static_cast<double>(value / d) +
+                static_cast<double>(value % d) / static_cast<double>(d);
+        }
+    }
+    UNPROTECT(1);
+    return ret;
+}
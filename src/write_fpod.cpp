@@ -0,0 +1,260 @@
+
+/*
+ *
+ * @author André Moan
+ *
+ *
+*/
+
+#include <Rcpp.h> // for interfacing with R
+#include <fpod.h> // for encoding data files
+#include <filesystem> // for extension()
+#include <stdexcept> // for std::invalid_argument
+#include <unordered_map>
+
+// defined in read_fpod.cpp
+const std::string getFiletype(const std::filesystem::path& file);
+
+// listToHeader: the inverse of headerToList. Fields that are missing from the
+// list are left at their defaults.
+fpod::Header listToHeader(const Rcpp::List& header) {
+    fpod::Header h;
+
+    auto has = [&header](const char* name) {
+        return header.containsElementNamed(name) && !Rf_isNull(header[name]);
+    };
+
+    if (has("pod_id")) {
+        // pod_id is a number in FPOD files, and a string in CPOD files
+        SEXP pod_id = header["pod_id"];
+        if (Rf_isString(pod_id)) {
+            h.pod_id = Rcpp::as<std::string>(pod_id);
+        } else {
+            h.pod_id = std::to_string(Rcpp::as<int>(pod_id));
+        }
+    }
+    if (has("first_logged_min")) h.first_logged_min = Rcpp::as<int>(header["first_logged_min"]);
+    if (has("last_logged_min")) h.last_logged_min = Rcpp::as<int>(header["last_logged_min"]);
+    if (has("water_depth")) h.water_depth = Rcpp::as<int>(header["water_depth"]);
+    if (has("deployment_depth")) h.deployment_depth = Rcpp::as<int>(header["deployment_depth"]);
+    if (has("lat_text")) h.lat_text = Rcpp::as<std::string>(header["lat_text"]);
+    if (has("lon_text")) h.lon_text = Rcpp::as<std::string>(header["lon_text"]);
+    if (has("location_text")) h.location_text = Rcpp::as<std::string>(header["location_text"]);
+    if (has("notes_text")) h.notes_text = Rcpp::as<std::string>(header["notes_text"]);
+    if (has("gmt_text")) h.gmt_text = Rcpp::as<std::string>(header["gmt_text"]);
+    if (has("pic_ver")) h.pic_ver = static_cast<uint8_t>(Rcpp::as<int>(header["pic_ver"]));
+    if (has("fpga_ver")) h.fpga_ver = Rcpp::as<int>(header["fpga_ver"]);
+    if (has("clicks_in_fp1")) {
+        h.source_clicks = static_cast<int64_t>(Rcpp::as<double>(header["clicks_in_fp1"]));
+    }
+    if (has("clicks_in_cp1")) {
+        h.source_clicks = static_cast<int64_t>(Rcpp::as<double>(header["clicks_in_cp1"]));
+    }
+    return h;
+}
+
+// [[Rcpp::export]]
+double writeSynthetic(const std::string file, Rcpp::List header, double minutes,
+                      double click_rate, double train_density,
+                      double wav_density, double seed) {
+
+    fpod::Format format = fpod::getFormat(getFiletype(file));
+    if (!format.is_cpod() && !format.is_fpod()) {
+        Rcpp::stop("Unknown file type: %s", format.ext);
+    }
+
+    fpod::SyntheticOptions options;
+    options.minutes = static_cast<int64_t>(minutes);
+    options.click_rate = click_rate;
+    options.train_density = train_density;
+    options.wav_density = wav_density;
+    options.seed = static_cast<uint64_t>(seed);
+
+    int64_t n_clicks;
+    try {
+        n_clicks = fpod::writeSynthetic(file, format, listToHeader(header), options);
+    } catch (const std::logic_error& e) {
+        Rcpp::stop("Invalid header: %s", e.what());
+    }
+
+    if (n_clicks < 0) {
+        Rcpp::stop("Unable to write file %s", file);
+    }
+    return static_cast<double>(n_clicks);
+}
+
+namespace {
+
+// integerColumn: the named column of the list, or an empty vector if the list
+// has no such column (as for the fields that are not stored in every format)
+Rcpp::IntegerVector integerColumn(const Rcpp::List& columns, const char* name) {
+    if (!columns.containsElementNamed(name) || Rf_isNull(columns[name])) {
+        return Rcpp::IntegerVector(0);
+    }
+    return Rcpp::as<Rcpp::IntegerVector>(columns[name]);
+}
+
+inline int valueAt(const Rcpp::IntegerVector& x, R_xlen_t i) {
+    return x.size() > 0 ? x[i] : 0;
+}
+
+} // namespace
+
+// [[Rcpp::export]]
+double writeFPOD(const std::string file, Rcpp::List header, Rcpp::List clicks,
+                 Rcpp::List env, Rcpp::IntegerVector wav_start,
+                 Rcpp::IntegerVector wav_length, Rcpp::IntegerVector wav_ipi,
+                 Rcpp::IntegerVector wav_spl) {
+
+    using namespace Rcpp;
+    fpod::Format format = fpod::getFormat(getFiletype(file));
+    if (!format.is_cpod() && !format.is_fpod()) {
+        stop("Unknown file type: %s", format.ext);
+    }
+    bool has_trains = format.ext == "FP3" || format.ext == "CP3";
+
+    // clicks, sorted by minute and microsec, where minute is the number of
+    // minute records before the click, minus 1
+    IntegerVector minute = integerColumn(clicks, "minute");
+    IntegerVector microsec = integerColumn(clicks, "microsec");
+    IntegerVector ncyc = integerColumn(clicks, "ncyc");
+    IntegerVector pkat = integerColumn(clicks, "pkat");
+    IntegerVector clk_ipi_range = integerColumn(clicks, "clk_ipi_range");
+    IntegerVector ipi_pre_max = integerColumn(clicks, "ipi_pre_max");
+    IntegerVector ipi_at_max = integerColumn(clicks, "ipi_at_max");
+    IntegerVector khz = integerColumn(clicks, "khz");
+    IntegerVector amp_at_max = integerColumn(clicks, "amp_at_max");
+    IntegerVector amp_reversals = integerColumn(clicks, "amp_reversals");
+    IntegerVector duration = integerColumn(clicks, "duration");
+    IntegerVector train_id = integerColumn(clicks, "train_id");
+    IntegerVector quality_level = integerColumn(clicks, "quality_level");
+    IntegerVector echo = integerColumn(clicks, "echo");
+    CharacterVector species = clicks.containsElementNamed("species") ?
+        as<CharacterVector>(clicks["species"]) : CharacterVector(0);
+
+    // env, one row per minute record, with the values as stored in the file
+    IntegerVector temp_deg_c = integerColumn(env, "temp_deg_c");
+    IntegerVector angle = integerColumn(env, "angle");
+    IntegerVector bat1 = integerColumn(env, "bat1");
+    IntegerVector bat2 = integerColumn(env, "bat2");
+    IntegerVector bat_use = integerColumn(env, "bat_use");
+    IntegerVector prior_min = integerColumn(env, "prior_min");
+    IntegerVector next_min = integerColumn(env, "next_min");
+    R_xlen_t n_minutes = bat1.size();
+
+    if (microsec.size() != minute.size()) {
+        stop("Clicks must have a microsec column");
+    }
+    if (has_trains && species.size() != minute.size()) {
+        stop("Clicks must have a species column to be written to %s files", format.ext);
+    }
+
+    std::unordered_map<std::string, uint8_t> species_index;
+    for (std::size_t i = 0; i < fpod::species_names.size(); i++) {
+        species_index[fpod::species_names[i]] = static_cast<uint8_t>(i);
+    }
+
+    fpod::RecordWriter writer(file, format);
+    if (!writer.is_open()) {
+        stop("Unable to write file %s", file);
+    }
+
+    fpod::Header h = listToHeader(header);
+    try {
+        writer.header(h);
+    } catch (const std::logic_error& e) {
+        stop("Invalid header: %s", e.what());
+    }
+
+    R_xlen_t minutes_written = 0;
+    auto writeMinute = [&](R_xlen_t k) {
+        fpod::EnvRecord record;
+        record.temp_deg_c = valueAt(temp_deg_c, k);
+        record.angle = valueAt(angle, k);
+        record.bat1 = valueAt(bat1, k);
+        record.bat2 = valueAt(bat2, k);
+        record.bat_use = bat_use.size() > 0 ? bat_use[k] : 1;
+        record.prior_min = prior_min.size() > 0 ? prior_min[k] == 1 : true;
+        record.next_min = valueAt(next_min, k) == 1;
+        try {
+            writer.minute(record, h.pic_ver);
+        } catch (const std::invalid_argument& e) {
+            stop("Can't encode env minute %d: %s", k + 1, e.what());
+        }
+    };
+
+    R_xlen_t i = 0;
+    try {
+        fpod::ClickRecord click;
+        fpod::TrainRecord train;
+        fpod::WavRecord wav;
+
+        for (; i < minute.size(); i++) {
+            if (minute[i] < -1 || minute[i] >= n_minutes) {
+                stop("Click %d is outside the minutes of env", i + 1);
+            }
+
+            // a click's minute is the number of minute records before it, minus 1
+            while (minutes_written <= minute[i]) {
+                writeMinute(minutes_written++);
+            }
+
+            click.microsec = microsec[i];
+            click.ncyc = static_cast<uint8_t>(valueAt(ncyc, i));
+            click.pkat = static_cast<uint8_t>(valueAt(pkat, i));
+            click.clk_ipi_range = static_cast<uint8_t>(valueAt(clk_ipi_range, i));
+            click.ipi_pre_max = static_cast<uint16_t>(valueAt(ipi_pre_max, i));
+            click.ipi_at_max = static_cast<uint16_t>(valueAt(ipi_at_max, i));
+            click.khz = static_cast<uint8_t>(valueAt(khz, i));
+            click.amp_at_max = static_cast<uint8_t>(valueAt(amp_at_max, i));
+            click.amp_reversals = static_cast<uint8_t>(valueAt(amp_reversals, i));
+            click.duration = valueAt(duration, i);
+
+            train = fpod::TrainRecord();
+            if (has_trains) {
+                auto it = species_index.find(as<std::string>(species[i]));
+                if (it == species_index.end()) {
+                    stop("Click %d has an unknown species", i + 1);
+                }
+                train.train_id = static_cast<uint8_t>(valueAt(train_id, i));
+                train.species = it->second;
+                train.quality_level = static_cast<uint8_t>(valueAt(quality_level, i));
+                train.echo = valueAt(echo, i) == 1;
+            }
+
+            if (format.is_cpod()) {
+                click.train_id = train.train_id;
+                click.species = train.species;
+                click.quality_level = train.quality_level;
+            } else if (train.species > 0) {
+                // clicks without train data have no species, and no train record
+                writer.train(train);
+            }
+            writer.click(click);
+
+            // wav data is returned by readFPOD with the last record first
+            if (format.is_fpod() && wav_start.size() > 0 && wav_start[i] != NA_INTEGER) {
+                for (int k = wav_length[i] / 7 - 1; k >= 0; k--) {
+                    R_xlen_t pos = wav_start[i] + 7 * k;
+                    for (int j = 0; j < 7; j++) {
+                        wav.ipi[j] = static_cast<uint8_t>(wav_ipi[pos + j]);
+                        wav.spl[j] = static_cast<uint8_t>(wav_spl[pos + j]);
+                    }
+                    writer.wav(wav);
+                }
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        stop("Can't encode click %d: %s", i + 1, e.what());
+    }
+
+    while (minutes_written < n_minutes) {
+        writeMinute(minutes_written++);
+    }
+
+    writer.end();
+    if (!writer.flush()) {
+        stop("Unable to write file %s", file);
+    }
+    return static_cast<double>(minute.size());
+}